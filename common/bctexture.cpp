@@ -0,0 +1,291 @@
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include "bctexture.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BCTEXTURE_SSE2
+#endif
+
+static std::uint16_t pack565(const int r, const int g, const int b) {
+	return static_cast<std::uint16_t>(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+static void unpack565(const std::uint16_t c, std::uint8_t* bgra) {
+	const int r = (c >> 11) & 31;
+	const int g = (c >> 5) & 63;
+	const int b = c & 31;
+	bgra[0] = (b << 3) | (b >> 2);
+	bgra[1] = (g << 2) | (g >> 4);
+	bgra[2] = (r << 3) | (r >> 2);
+	bgra[3] = 255;
+}
+
+// 4 BGRA entries: c0, c1 and the two interpolated colors (or their average and transparent black when c0 <= c1)
+static void bc1_palette(const std::uint8_t* blk, std::uint8_t* pal) {
+	const std::uint16_t c0 = blk[0] | blk[1] << 8;
+	const std::uint16_t c1 = blk[2] | blk[3] << 8;
+	unpack565(c0, pal);
+	unpack565(c1, pal + 4);
+#ifdef BCTEXTURE_SSE2
+	const __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pal)), _mm_setzero_si128()); // c0 | c1
+	const __m128i b = _mm_shuffle_epi32(a, _MM_SHUFFLE(1, 0, 3, 2));                                                   // c1 | c0
+	__m128i m;
+	if (c0 > c1) // x*0x5556>>16 == x/3 for every x we can get here
+		m = _mm_mulhi_epu16(_mm_add_epi16(_mm_add_epi16(a, a), b), _mm_set1_epi16(0x5556));
+	else
+		m = _mm_and_si128(_mm_srli_epi16(_mm_add_epi16(a, b), 1), _mm_set_epi32(0, 0, -1, -1));
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(pal + 8), _mm_packus_epi16(m, m));
+#else
+	for (int t = 0; t < 4; t++) {
+		if (c0 > c1) {
+			pal[8 + t] = (2 * pal[t] + pal[4 + t]) / 3;
+			pal[12 + t] = (pal[t] + 2 * pal[4 + t]) / 3;
+		}
+		else {
+			pal[8 + t] = (pal[t] + pal[4 + t]) / 2;
+			pal[12 + t] = 0;
+		}
+	}
+#endif
+}
+
+// 8 entries: e0, e1 and six interpolated values, or four interpolated values plus 0 and 255 when e0 <= e1
+static void bc4_palette(const std::uint8_t* blk, std::uint8_t* pal) {
+	const int e0 = blk[0];
+	const int e1 = blk[1];
+#ifdef BCTEXTURE_SSE2
+	__m128i s;
+	if (e0 > e1) {
+		s = _mm_add_epi16(_mm_mullo_epi16(_mm_set1_epi16(e0), _mm_setr_epi16(7, 0, 6, 5, 4, 3, 2, 1)),
+		                  _mm_mullo_epi16(_mm_set1_epi16(e1), _mm_setr_epi16(0, 7, 1, 2, 3, 4, 5, 6)));
+		s = _mm_mulhi_epu16(_mm_add_epi16(s, _mm_set1_epi16(3)), _mm_set1_epi16(9363));  // /7
+	}
+	else {
+		s = _mm_add_epi16(_mm_mullo_epi16(_mm_set1_epi16(e0), _mm_setr_epi16(5, 0, 4, 3, 2, 1, 0, 0)),
+		                  _mm_mullo_epi16(_mm_set1_epi16(e1), _mm_setr_epi16(0, 5, 1, 2, 3, 4, 0, 0)));
+		s = _mm_mulhi_epu16(_mm_add_epi16(s, _mm_set1_epi16(2)), _mm_set1_epi16(13108)); // /5
+		s = _mm_insert_epi16(_mm_insert_epi16(s, 0, 6), 255, 7);
+	}
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(pal), _mm_packus_epi16(s, s));
+#else
+	pal[0] = e0;
+	pal[1] = e1;
+	if (e0 > e1) {
+		for (int i = 1; i < 7; i++) pal[i + 1] = ((7 - i) * e0 + i * e1 + 3) / 7;
+	}
+	else {
+		for (int i = 1; i < 5; i++) pal[i + 1] = ((5 - i) * e0 + i * e1 + 2) / 5;
+		pal[6] = 0;
+		pal[7] = 255;
+	}
+#endif
+}
+
+static std::uint32_t bc1_indices(const std::uint8_t* blk) {
+	return blk[4] | blk[5] << 8 | blk[6] << 16 | static_cast<std::uint32_t>(blk[7]) << 24;
+}
+
+static std::uint64_t bc4_indices(const std::uint8_t* blk) {
+	std::uint64_t bits = 0;
+	for (int i = 6; i--; bits = bits << 8 | blk[2 + i]);
+	return bits;
+}
+
+static std::uint8_t rebuild_z(const std::uint8_t r, const std::uint8_t g, const bool negative) {
+	const float x = r / 255.f * 2.f - 1.f;
+	const float y = g / 255.f * 2.f - 1.f;
+	float z = std::sqrt(std::max(0.f, 1.f - x * x - y * y));
+	if (negative) z = -z;
+	return static_cast<std::uint8_t>((z * .5f + .5f) * 255.f + .5f);
+}
+
+static void encode_bc1(const std::uint8_t* bgra, std::uint8_t* blk) {
+	float mean[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++) mean[c] += bgra[i * 4 + c] / 16.f;
+	float cov[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		float d[3];
+		for (int c = 0; c < 3; c++) d[c] = bgra[i * 4 + c] - mean[c];
+		cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+		cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+	}
+	// principal axis by power iteration
+	float axis[3] = { 1, 1, 1 };
+	for (int it = 0; it < 8; it++) {
+		float a[3] = { cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+		               cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+		               cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2] };
+		float l = std::max(std::abs(a[0]), std::max(std::abs(a[1]), std::abs(a[2])));
+		if (l < 1e-6f) break;
+		for (int c = 0; c < 3; c++) axis[c] = a[c] / l;
+	}
+	int imin = 0, imax = 0;
+	float pmin = 1e30f, pmax = -1e30f;
+	for (int i = 0; i < 16; i++) {
+		float p = bgra[i * 4] * axis[0] + bgra[i * 4 + 1] * axis[1] + bgra[i * 4 + 2] * axis[2];
+		if (p < pmin) { pmin = p; imin = i; }
+		if (p > pmax) { pmax = p; imax = i; }
+	}
+	std::uint16_t c0 = pack565(bgra[imax * 4 + 2], bgra[imax * 4 + 1], bgra[imax * 4]);
+	std::uint16_t c1 = pack565(bgra[imin * 4 + 2], bgra[imin * 4 + 1], bgra[imin * 4]);
+	if (c0 < c1) std::swap(c0, c1);
+	blk[0] = c0 & 0xff; blk[1] = c0 >> 8;
+	blk[2] = c1 & 0xff; blk[3] = c1 >> 8;
+	std::uint8_t pal[16];
+	bc1_palette(blk, pal);
+	const int ncolors = c0 > c1 ? 4 : 1;
+	std::uint32_t indices = 0;
+	for (int i = 0; i < 16; i++) {
+		int best = 0, bestd = 1 << 30;
+		for (int k = 0; k < ncolors; k++) {
+			int d = 0;
+			for (int c = 0; c < 3; c++) d += (bgra[i * 4 + c] - pal[k * 4 + c]) * (bgra[i * 4 + c] - pal[k * 4 + c]);
+			if (d < bestd) { bestd = d; best = k; }
+		}
+		indices |= static_cast<std::uint32_t>(best) << (2 * i);
+	}
+	for (int i = 0; i < 4; i++) blk[4 + i] = indices >> (8 * i) & 0xff;
+}
+
+static void encode_bc4(const std::uint8_t* v, std::uint8_t* blk) {
+	std::uint8_t lo = 255, hi = 0;
+	for (int i = 0; i < 16; i++) {
+		lo = std::min(lo, v[i]);
+		hi = std::max(hi, v[i]);
+	}
+	blk[0] = hi;
+	blk[1] = lo;
+	std::uint8_t pal[8];
+	bc4_palette(blk, pal);
+	const int nvalues = hi > lo ? 8 : 1;
+	std::uint64_t indices = 0;
+	for (int i = 0; i < 16; i++) {
+		int best = 0;
+		for (int k = 1; k < nvalues; k++)
+			if (std::abs(v[i] - pal[k]) < std::abs(v[i] - pal[best])) best = k;
+		indices |= static_cast<std::uint64_t>(best) << (3 * i);
+	}
+	for (int i = 0; i < 6; i++) blk[2 + i] = indices >> (8 * i) & 0xff;
+}
+
+BCTexture::BCTexture() : blocks(), width(0), height(0), blocks_per_row(0), block_bytes(0), format(NONE) {}
+
+bool BCTexture::encode(const TGAImage& img, const Format fmt) {
+	if (img.get_width() <= 0 || img.get_height() <= 0 || (BC1 != fmt && BC5 != fmt)) {
+		std::cerr << "can't compress an empty image\n";
+		return false;
+	}
+	width = img.get_width();
+	height = img.get_height();
+	format = fmt;
+	blocks_per_row = (width + 3) / 4;
+	const int nrows = (height + 3) / 4;
+
+	// texels are fetched clamped to the edge, so partial blocks replicate the last row/column
+	auto fetch = [&](int x, int y) {
+		TGAColor c = img.get(std::min(x, width - 1), std::min(y, height - 1));
+		if (1 == c.bytespp) c.bgra[1] = c.bgra[2] = c.bgra[0];
+		return c;
+	};
+	bool signs = false;
+	if (BC5 == fmt) {
+		for (int y = 0; y < height && !signs; y++)
+			for (int x = 0; x < width && !signs; x++)
+				signs = fetch(x, y).bgra[0] < 128;
+	}
+	block_bytes = (BC1 == fmt ? 8 : (signs ? 18 : 16));
+	blocks = huge_vector<std::uint8_t>(static_cast<size_t>(blocks_per_row) * nrows * block_bytes, 0);
+
+	std::uint8_t bgra[64];
+	std::uint8_t r[16], g[16];
+	for (int by = 0; by < nrows; by++) {
+		for (int bx = 0; bx < blocks_per_row; bx++) {
+			std::uint8_t* blk = blocks.data() + (static_cast<size_t>(by) * blocks_per_row + bx) * block_bytes;
+			std::uint16_t negative = 0;
+			for (int i = 0; i < 16; i++) {
+				TGAColor c = fetch(bx * 4 + (i & 3), by * 4 + (i >> 2));
+				memcpy(bgra + i * 4, c.bgra, 4);
+				r[i] = c.bgra[2];
+				g[i] = c.bgra[1];
+				if (c.bgra[0] < 128) negative |= 1 << i;
+			}
+			if (BC1 == fmt) {
+				encode_bc1(bgra, blk);
+				continue;
+			}
+			encode_bc4(r, blk);
+			encode_bc4(g, blk + 8);
+			if (signs) {
+				blk[16] = negative & 0xff;
+				blk[17] = negative >> 8;
+			}
+		}
+	}
+	return true;
+}
+
+const std::uint8_t* BCTexture::block(const int x, const int y) const {
+	return blocks.data() + (static_cast<size_t>(y >> 2) * blocks_per_row + (x >> 2)) * block_bytes;
+}
+
+TGAColor BCTexture::get(const int x, const int y) const {
+	if (!blocks.size() || x < 0 || y < 0 || x >= width || y >= height)
+		return {};
+	const std::uint8_t* blk = block(x, y);
+	const int t = (x & 3) + ((y & 3) << 2);
+	if (BC1 == format) {
+		std::uint8_t pal[16];
+		bc1_palette(blk, pal);
+		return TGAColor(pal + (bc1_indices(blk) >> (2 * t) & 3) * 4, 3);
+	}
+	std::uint8_t rpal[8], gpal[8];
+	bc4_palette(blk, rpal);
+	bc4_palette(blk + 8, gpal);
+	const std::uint8_t r = rpal[bc4_indices(blk) >> (3 * t) & 7];
+	const std::uint8_t g = gpal[bc4_indices(blk + 8) >> (3 * t) & 7];
+	const bool negative = 18 == block_bytes && ((blk[16] | blk[17] << 8) >> t & 1);
+	return TGAColor(r, g, rebuild_z(r, g, negative));
+}
+
+void BCTexture::decode_block(const int bx, const int by, std::uint8_t* bgra) const {
+	const std::uint8_t* blk = block(bx * 4, by * 4);
+	if (BC1 == format) {
+		std::uint8_t pal[16];
+		bc1_palette(blk, pal);
+		std::uint32_t indices = bc1_indices(blk);
+		for (int i = 0; i < 16; i++, indices >>= 2)
+			memcpy(bgra + i * 4, pal + (indices & 3) * 4, 4);
+		return;
+	}
+	std::uint8_t rpal[8], gpal[8];
+	bc4_palette(blk, rpal);
+	bc4_palette(blk + 8, gpal);
+	std::uint64_t ri = bc4_indices(blk);
+	std::uint64_t gi = bc4_indices(blk + 8);
+	const int negative = 18 == block_bytes ? (blk[16] | blk[17] << 8) : 0;
+	for (int i = 0; i < 16; i++, ri >>= 3, gi >>= 3) {
+		bgra[i * 4 + 2] = rpal[ri & 7];
+		bgra[i * 4 + 1] = gpal[gi & 7];
+		bgra[i * 4 + 0] = rebuild_z(bgra[i * 4 + 2], bgra[i * 4 + 1], negative >> i & 1);
+		bgra[i * 4 + 3] = 255;
+	}
+}
+
+int BCTexture::get_width() const {
+	return width;
+}
+
+int BCTexture::get_height() const {
+	return height;
+}
+
+std::size_t BCTexture::memory() const {
+	return blocks.size();
+}
+
+bool BCTexture::empty() const {
+	return blocks.empty();
+}
@@ -0,0 +1,38 @@
+#ifndef __BCTEXTURE_H__
+#define __BCTEXTURE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "tgaimage.h"
+
+// In-memory block-compressed texture, 4x4 texels per block.
+// BC1 stores RGB as two RGB565 endpoints and 2-bit indices (8 bytes per block, 6x smaller than 24bpp).
+// BC5 stores two channels (R and G) as two BC4 blocks (16 bytes per block, 3x smaller than 24bpp),
+// the third channel of a normal map is rebuilt as sqrt(1-x^2-y^2) on sampling. Object space normal
+// maps may point away from the viewer, so when any texel has a negative z the encoder keeps one sign
+// bit per texel next to each block (18 bytes per block).
+class BCTexture {
+public:
+	enum Format { NONE = 0, BC1 = 1, BC5 = 5 };
+
+	BCTexture();
+	bool encode(const TGAImage& img, const Format fmt);
+	TGAColor get(const int x, const int y) const;
+	void decode_block(const int bx, const int by, std::uint8_t* bgra) const; // 16 texels, 4 bytes each, row major
+	int get_width() const;
+	int get_height() const;
+	std::size_t memory() const;
+	bool empty() const;
+private:
+	huge_vector<std::uint8_t> blocks;
+	int width;
+	int height;
+	int blocks_per_row;
+	int block_bytes;
+	Format format;
+
+	const std::uint8_t* block(const int x, const int y) const;
+};
+
+#endif //__BCTEXTURE_H__
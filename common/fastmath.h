@@ -0,0 +1,153 @@
+#ifndef __FASTMATH_H__
+#define __FASTMATH_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+
+// Polynomial stand-ins for libm in shaders, at three precision tiers. The coefficients are minimax fits, the
+// errors below are the largest seen against double precision libm over the whole valid domain, rounded up
+// (common/tests/fastmath_test.cpp checks them):
+//
+//              FAST_LOW    FAST_MEDIUM  FAST_HIGH
+//   atan       6.1e-4      1.2e-5       1.7e-7     absolute, radians
+//   acos       3.3e-4      5.1e-6       3.5e-7     absolute, radians
+//   sin, cos   1.6e-4      6.4e-7       8.8e-8     absolute, for |x| < 8192
+//   exp2       7.5e-5      2.4e-7       1.1e-7     relative, for -125 <= x < 128, clamped outside
+//   log2       9.5e-5      2.1e-6       9.7e-8     absolute, relative past |log2 x| = 1, for normal x > 0
+//   pow        3.4e-3      7.4e-5       7.8e-6     relative, for y <= 50; exp2(y log2 x) so the error grows with y
+//   rsqrt      1.8e-3      4.8e-6       9.0e-8     relative, for normal x > 0, FAST_HIGH is 1 / sqrt
+//
+// pow(0, y) is 0 and pow(0, 0) is 1. There are no branches or table lookups, loops over arrays vectorize at -O3
+// (acos only without errno on sqrt). In scalar code the gain over libm depends on the libm; glibc's exp2f
+// and powf are about as fast as these.
+
+enum FastPrecision { FAST_LOW, FAST_MEDIUM, FAST_HIGH };
+
+template<FastPrecision P> struct FastCoefficients;
+
+template<> struct FastCoefficients<FAST_LOW> {
+	static constexpr float atan[] = { 9.953579307e-01f, -2.886902094e-01f, 7.933902740e-02f };
+	static constexpr float acos[] = { 1.570470214e+00f, -2.054975331e-01f, 5.138952658e-02f };
+	static constexpr float sin[] = { 9.990314245e-01f, -1.603440195e-01f };
+	static constexpr float cos[] = { 9.999900460e-01f, -4.997081459e-01f, 4.039853439e-02f };
+	static constexpr float exp2[] = { 9.999280572e-01f, 6.932609677e-01f, 2.426111251e-01f, 5.517166853e-02f };
+	static constexpr float log2[] = { 1.441547990e+00f, -7.191348672e-01f, 5.235238671e-01f, -4.097489119e-01f };
+};
+
+template<> struct FastCoefficients<FAST_MEDIUM> {
+	static constexpr float atan[] = { 9.998663068e-01f, -3.303047717e-01f, 1.801592857e-01f, -8.515633643e-02f, 2.084510960e-02f };
+	static constexpr float acos[] = { 1.570791483e+00f, -2.142806053e-01f, 8.563837409e-02f, -3.761821613e-02f, 9.732967243e-03f };
+	static constexpr float sin[] = { 9.999949932e-01f, -1.666016132e-01f, 8.121557534e-03f };
+	static constexpr float cos[] = { 1.000000000e+00f, -4.999985695e-01f, 4.165502638e-02f, -1.358590904e-03f };
+	static constexpr float exp2[] = { 1.000000119e+00f, 6.931469440e-01f, 2.402212024e-01f, 5.550713092e-02f, 9.675540961e-03f, 1.327647245e-03f };
+	static constexpr float log2[] = { 1.442728043e+00f, -7.214409113e-01f, 4.784080982e-01f, -3.566595912e-01f, 3.328851163e-01f, -2.910108864e-01f };
+};
+
+template<> struct FastCoefficients<FAST_HIGH> {
+	static constexpr float atan[] = { 9.999993443e-01f, -3.332985938e-01f, 1.994656622e-01f, -1.390862912e-01f, 9.642197192e-02f, -5.591231957e-02f, 2.186295390e-02f, -4.054565914e-03f };
+	static constexpr float acos[] = { 1.570796371e+00f, -2.145998925e-01f, 8.899926394e-02f, -5.031278357e-02f, 3.133547306e-02f, -1.780898683e-02f, 7.245449815e-03f, -1.441480475e-03f };
+	static constexpr float sin[] = { 1.000000000e+00f, -1.666663736e-01f, 8.331584744e-03f, -1.946211705e-04f };
+	static constexpr float cos[] = { 1.000000000e+00f, -5.000000000e-01f, 4.166661575e-02f, -1.388661913e-03f, 2.437992953e-05f };
+	static constexpr float exp2[] = { 1.000000000e+00f, 6.931471825e-01f, 2.402264625e-01f, 5.550328642e-02f, 9.618489072e-03f, 1.339993090e-03f, 1.534581243e-04f };
+	static constexpr float log2[] = { 1.442695141e+00f, -7.213455439e-01f, 4.808906317e-01f, -3.608440757e-01f, 2.888970971e-01f, -2.359428108e-01f, 1.994818449e-01f, -2.261666507e-01f, 2.122896016e-01f };
+};
+
+// c[0] + x (c[1] + x (c[2] + ...)), unrolled at compile time
+template<std::size_t I = 0, std::size_t N> inline float fast_horner(const float (&c)[N], const float x) {
+	if constexpr (I + 1 == N) return c[I];
+	else return fast_horner<I + 1>(c, x) * x + c[I];
+}
+
+inline std::uint32_t fast_float_bits(const float f) {
+	std::uint32_t u;
+	std::memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+inline float fast_bits_float(const std::uint32_t u) {
+	float f;
+	std::memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+// a where the condition holds, b elsewhere; gcc keeps ?: on floats as a branch unless floating point traps are off
+inline float fast_select(const bool condition, const float a, const float b) {
+	const std::uint32_t mask = 0u - condition;
+	return fast_bits_float((fast_float_bits(a) & mask) | (fast_float_bits(b) & ~mask));
+}
+
+// Adding 1.5 2^23 rounds a float below 2^22 in magnitude to the nearest integer, which the low mantissa bits then hold
+// in two's complement, without a conversion to int that could trap.
+const float FAST_ROUNDING = 12582912.f;
+
+// atan(x) = x P(x^2) on [-1, 1], pi/2 - atan(1/x) outside
+template<FastPrecision P = FAST_MEDIUM> inline float fast_atan(const float x) {
+	const float a = std::fabs(x);
+	const bool outside = a > 1.f;
+	const float t = fast_select(outside, 1.f / a, a);
+	const float r = t * fast_horner(FastCoefficients<P>::atan, t * t);
+	return std::copysign(fast_select(outside, 1.57079637f - r, r), x);
+}
+
+// acos(x) = sqrt(1 - x) P(x) on [0, 1], pi - acos(-x) below
+// (with errno set by sqrt, the default for gcc, this one doesn't vectorize)
+template<FastPrecision P = FAST_MEDIUM> inline float fast_acos(const float x) {
+	const float a = fast_select(std::fabs(x) < 1.f, std::fabs(x), 1.f);
+	const float r = std::sqrt(1.f - a) * fast_horner(FastCoefficients<P>::acos, a);
+	return fast_select(x < 0, 3.14159274f - r, r);
+}
+
+// x = q pi/2 + r with |r| <= pi/4, pi/2 is split in three so that q times each of the first two parts is exact
+template<FastPrecision P> inline float fast_quadrant(const float x, const std::uint32_t quadrant_offset) {
+	const float rounded = x * 0.636619772f + FAST_ROUNDING;
+	const float q = rounded - FAST_ROUNDING;
+	const float r = ((x - q * 1.5703125f) - q * 4.83751297e-4f) - q * 7.54978995e-8f;
+	const float s = r * r;
+	const float sin = r * fast_horner(FastCoefficients<P>::sin, s);
+	const float cos = fast_horner(FastCoefficients<P>::cos, s);
+	const std::uint32_t quadrant = fast_float_bits(rounded) + quadrant_offset;
+	return fast_bits_float(fast_float_bits(fast_select(quadrant & 1, cos, sin)) ^ (quadrant & 2) << 30);
+}
+
+template<FastPrecision P = FAST_MEDIUM> inline float fast_sin(const float x) {
+	return fast_quadrant<P>(x, 0);
+}
+
+template<FastPrecision P = FAST_MEDIUM> inline float fast_cos(const float x) {
+	return fast_quadrant<P>(x, 1);
+}
+
+// 2^x = 2^i 2^f with i the nearest integer and f in [-1/2, 1/2], 2^i goes straight into the exponent bits
+// (x is clamped to the last float below 128, where i = 128 and 2^f < 1 still fits the exponent)
+template<FastPrecision P = FAST_MEDIUM> inline float fast_exp2(float x) {
+	x = fast_select(x > -125.f, x, -125.f);
+	x = fast_select(x < 127.99999f, x, 127.99999f);
+	const float rounded = x + FAST_ROUNDING;
+	const float p = fast_horner(FastCoefficients<P>::exp2, x - (rounded - FAST_ROUNDING));
+	return fast_bits_float(fast_float_bits(p) + ((fast_float_bits(rounded) - fast_float_bits(FAST_ROUNDING)) << 23));
+}
+
+// x = 2^e m with m in [2/3, 4/3), log2(m) = t P(t) for t = m - 1
+template<FastPrecision P = FAST_MEDIUM> inline float fast_log2(const float x) {
+	const std::uint32_t bits = fast_float_bits(x);
+	const std::int32_t e = static_cast<std::int32_t>(bits - 0x3f2aaaab) >> 23;
+	const float t = fast_bits_float(bits - (static_cast<std::uint32_t>(e) << 23)) - 1.f;
+	return static_cast<float>(e) + t * fast_horner(FastCoefficients<P>::log2, t);
+}
+
+template<FastPrecision P = FAST_MEDIUM> inline float fast_pow(const float x, const float y) {
+	const float res = fast_exp2<P>(y * fast_log2<P>(x));
+	return fast_select(x > 0, res, fast_select(y == 0, 1.f, 0.f));
+}
+
+// the bit trick estimate refined by Newton steps x (1.5 - f/2 x^2), one for FAST_LOW and two for FAST_MEDIUM
+template<FastPrecision P = FAST_MEDIUM> inline float fast_rsqrt(const float f) {
+	if constexpr (P == FAST_HIGH) return 1.f / std::sqrt(f);
+	float x = fast_bits_float(0x5f375a86 - (fast_float_bits(f) >> 1));
+	x = x * (1.5f - .5f * f * x * x);
+	return P == FAST_LOW ? x : x * (1.5f - .5f * f * x * x);
+}
+
+#endif //__FASTMATH_H__
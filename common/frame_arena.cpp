@@ -0,0 +1,65 @@
+#include <cassert>
+#include "frame_arena.h"
+#include "huge_pages.h"
+
+FrameArena::FrameArena(const std::size_t capacity) : chunks(), offset(0), in_use(0), peak(0), widest(cache_line) {
+	if (capacity) add_chunk(capacity);
+}
+
+FrameArena::~FrameArena() {
+	release();
+}
+
+void FrameArena::add_chunk(const std::size_t size) {
+	chunks.push_back(Chunk{ static_cast<std::uint8_t*>(huge_allocate(size)), size });
+	offset = 0;
+}
+
+void FrameArena::release() {
+	for (const Chunk& c : chunks) huge_deallocate(c.memory, c.size);
+	chunks.clear();
+	offset = 0;
+}
+
+void* FrameArena::allocate(const std::size_t bytes, const std::size_t alignment) {
+	assert(alignment && !(alignment & (alignment - 1)));
+	widest = std::max(widest, alignment);
+	if (!chunks.empty()) {
+		const Chunk& c = chunks.back();
+		const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(c.memory);
+		const std::size_t start = ((base + offset + alignment - 1) & ~(alignment - 1)) - base;
+		if (start + bytes <= c.size) {
+			in_use += start - offset + bytes;
+			offset = start + bytes;
+			return c.memory + start;
+		}
+	}
+	// a new chunk at least twice the last one, so that a growing frame needs few of them
+	const std::size_t padding = alignment > cache_line ? alignment - cache_line : 0;
+	add_chunk(std::max(bytes + padding, chunks.empty() ? std::size_t(1) << 20 : chunks.back().size * 2));
+	return allocate(bytes, alignment);
+}
+
+void FrameArena::reset() {
+	peak = std::max(peak, in_use);
+	if (chunks.size() > 1) {
+		release();
+		add_chunk(peak + widest);
+	}
+	offset = 0;
+	in_use = 0;
+}
+
+std::size_t FrameArena::used() const {
+	return in_use;
+}
+
+std::size_t FrameArena::high_water() const {
+	return std::max(peak, in_use);
+}
+
+std::size_t FrameArena::capacity() const {
+	std::size_t total = 0;
+	for (const Chunk& c : chunks) total += c.size;
+	return total;
+}
@@ -0,0 +1,50 @@
+#ifndef __FRAME_ARENA_H__
+#define __FRAME_ARENA_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#include "huge_pages.h"
+
+// Bump allocator for the transient buffers of a frame: depth and shadow buffers, colour targets, scratch.
+// allocate() hands out blocks aligned to at least a cache line, reset() takes all of them back at once by
+// rewinding, without touching the memory. A frame that outgrows the arena continues in extra chunks, and the
+// next reset() trades all chunks for one as large as the high water mark, so a loop of similar frames stops
+// allocating after the first one. Nothing is constructed or destroyed, blocks are for trivial types.
+// One thread per arena.
+class FrameArena {
+public:
+	explicit FrameArena(const std::size_t capacity = 0);
+	~FrameArena();
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	void* allocate(const std::size_t bytes, const std::size_t alignment = cache_line);
+	template<class T> T* allocate(const std::size_t n) {
+		static_assert(std::is_trivially_destructible<T>::value, "arena blocks are never destroyed");
+		return static_cast<T*>(allocate(n * sizeof(T), std::max(alignof(T), cache_line)));
+	}
+	void reset(); // every block handed out so far is invalid afterwards
+	std::size_t used() const;       // bytes handed out since the last reset, alignment padding included
+	std::size_t high_water() const; // the most bytes used between two resets
+	std::size_t capacity() const;
+
+	static constexpr std::size_t cache_line = cache_line_size;
+private:
+	struct Chunk {
+		std::uint8_t* memory;
+		std::size_t size;
+	};
+	std::vector<Chunk> chunks; // blocks come from the last one
+	std::size_t offset;        // first free byte in the last chunk
+	std::size_t in_use;
+	std::size_t peak;
+	std::size_t widest; // largest alignment asked for, padding up to it depends on where a chunk lands
+
+	void add_chunk(const std::size_t size);
+	void release();
+};
+
+#endif //__FRAME_ARENA_H__
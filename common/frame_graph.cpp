@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cassert>
+#include "frame_graph.h"
+
+static const std::size_t none = std::numeric_limits<std::size_t>::max();
+
+FrameGraph::FrameGraph(ThreadPool& pool) : pool(pool), resources(), passes(), slots() {
+}
+
+FrameGraph::Resource FrameGraph::create_buffer(const std::string& name, const int width, const int height, const float clear) {
+	resources.push_back(ResourceInfo{ name, width, height, 0, clear, none, {} });
+	return resources.size() - 1;
+}
+
+FrameGraph::Resource FrameGraph::create_image(const std::string& name, const int width, const int height, const int bpp) {
+	resources.push_back(ResourceInfo{ name, width, height, bpp, 0.f, none, {} });
+	return resources.size() - 1;
+}
+
+void FrameGraph::add_pass(const std::string& name, const std::vector<Resource>& reads, const std::vector<Resource>& writes, std::function<void()> run) {
+	passes.push_back(Pass{ name, reads, writes, std::move(run), false, false, {}, {} });
+}
+
+void FrameGraph::output(const Resource image, const std::string& filename) {
+	add_pass("output " + filename, { image }, {}, [this, image, filename]() { this->image(image).write_tga_file(filename); });
+	passes.back().output = true;
+}
+
+// Passes are taken in the order they were added: a pass waits for the last writer of everything it touches,
+// and a writer also waits for the readers of the previous contents. Resources are then laid out in the order
+// they are first used; one can move into a slot when all uses of the slot's earlier occupants are ancestors
+// of its first pass, which every later use of it descends from.
+void FrameGraph::compile() {
+	std::vector<std::size_t> writer(resources.size(), none);
+	std::vector<std::vector<std::size_t>> readers(resources.size());
+	for (std::size_t p = 0; p < passes.size(); p++) {
+		Pass& pass = passes[p];
+		pass.dependencies.clear();
+		pass.creates.clear();
+		auto depend = [&pass, p](const std::size_t d) {
+			if (d != none && d != p && std::find(pass.dependencies.begin(), pass.dependencies.end(), d) == pass.dependencies.end())
+				pass.dependencies.push_back(d);
+		};
+		for (const Resource r : pass.reads) depend(writer[r]);
+		for (const Resource r : pass.writes) {
+			depend(writer[r]);
+			for (const std::size_t q : readers[r]) depend(q);
+		}
+		for (const Resource r : pass.reads) readers[r].push_back(p);
+		for (const Resource r : pass.writes) {
+			writer[r] = p;
+			readers[r].clear();
+		}
+	}
+
+	for (Pass& pass : passes) pass.culled = !pass.output;
+	for (std::size_t p = passes.size(); p--;)
+		if (!passes[p].culled)
+			for (const std::size_t d : passes[p].dependencies) passes[d].culled = false;
+
+	std::vector<std::vector<bool>> ancestor(passes.size(), std::vector<bool>(passes.size(), false));
+	for (ResourceInfo& r : resources) {
+		r.slot = none;
+		r.users.clear();
+	}
+	for (std::size_t p = 0; p < passes.size(); p++) {
+		if (passes[p].culled) continue;
+		for (const std::size_t d : passes[p].dependencies) {
+			ancestor[p][d] = true;
+			for (std::size_t a = 0; a < d; a++)
+				if (ancestor[d][a]) ancestor[p][a] = true;
+		}
+		for (const std::vector<Resource>* list : { &passes[p].reads, &passes[p].writes })
+			for (const Resource r : *list)
+				if (resources[r].users.empty() || resources[r].users.back() != p) resources[r].users.push_back(p);
+	}
+
+	std::vector<Resource> order;
+	for (Resource r = 0; r < resources.size(); r++)
+		if (!resources[r].users.empty()) order.push_back(r);
+	std::stable_sort(order.begin(), order.end(), [this](const Resource a, const Resource b) { return resources[a].users[0] < resources[b].users[0]; });
+
+	slots.clear();
+	for (const Resource r : order) {
+		ResourceInfo& res = resources[r];
+		const std::size_t first = res.users[0];
+		for (std::size_t s = 0; s < slots.size() && res.slot == none; s++) {
+			const ResourceInfo& held = resources[slots[s].occupants[0]];
+			bool free = held.width == res.width && held.height == res.height && held.bpp == res.bpp;
+			for (std::size_t i = 0; free && i < slots[s].occupants.size(); i++)
+				for (const std::size_t u : resources[slots[s].occupants[i]].users)
+					free = free && ancestor[first][u];
+			if (free) res.slot = s;
+		}
+		if (res.slot == none) {
+			res.slot = slots.size();
+			slots.emplace_back();
+			if (res.bpp) slots.back().image = TGAImage(res.width, res.height, res.bpp);
+			else slots.back().buffer.resize(static_cast<std::size_t>(res.width) * res.height);
+		}
+		slots[res.slot].occupants.push_back(r);
+		passes[first].creates.push_back(r);
+	}
+}
+
+void FrameGraph::execute() {
+	compile();
+	TaskGraph graph(pool);
+	std::vector<std::size_t> task(passes.size(), none);
+	for (std::size_t p = 0; p < passes.size(); p++) {
+		if (passes[p].culled) continue;
+		std::vector<std::size_t> dependencies;
+		for (const std::size_t d : passes[p].dependencies) dependencies.push_back(task[d]);
+		task[p] = graph.add([this, p]() {
+			for (const Resource r : passes[p].creates) {
+				Slot& slot = slots[resources[r].slot];
+				if (resources[r].bpp) slot.image.clear();
+				else std::fill(slot.buffer.begin(), slot.buffer.end(), resources[r].clear);
+			}
+			passes[p].run();
+		}, dependencies);
+	}
+	graph.run();
+}
+
+float* FrameGraph::buffer(const Resource r) {
+	assert(!resources[r].bpp && resources[r].slot != none);
+	return slots[resources[r].slot].buffer.data();
+}
+
+TGAImage& FrameGraph::image(const Resource r) {
+	assert(resources[r].bpp && resources[r].slot != none);
+	return slots[resources[r].slot].image;
+}
+
+bool FrameGraph::culled(const std::string& pass) const {
+	for (const Pass& p : passes)
+		if (p.name == pass) return p.culled;
+	return false;
+}
+
+std::size_t FrameGraph::bytes(const ResourceInfo& r) const {
+	return static_cast<std::size_t>(r.width) * r.height * (r.bpp ? r.bpp : sizeof(float));
+}
+
+std::size_t FrameGraph::memory() const {
+	std::size_t total = 0;
+	for (const Slot& s : slots) total += bytes(resources[s.occupants[0]]);
+	return total;
+}
+
+std::size_t FrameGraph::unaliased_memory() const {
+	std::size_t total = 0;
+	for (const ResourceInfo& r : resources)
+		if (!r.users.empty()) total += bytes(r);
+	return total;
+}
@@ -0,0 +1,72 @@
+#ifndef __FRAME_GRAPH_H__
+#define __FRAME_GRAPH_H__
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+#include "huge_pages.h"
+#include "tgaimage.h"
+#include "thread_pool.h"
+
+// A frame declared as passes over transient resources, float buffers (depth, shadow maps) and colour targets.
+// A pass lists what it reads and writes and gets the storage from buffer() and image() while it runs; a resource
+// is cleared right before the first pass using it. execute() works back from the images requested with output():
+// passes nothing requested depends on are dropped and their resources never allocated, the others run on the
+// pool as soon as the passes they depend on are done. Two resources of the same size and format share storage
+// when every use of the first is done before the second is created.
+class FrameGraph {
+public:
+	typedef std::size_t Resource;
+
+	explicit FrameGraph(ThreadPool& pool = ThreadPool::shared());
+	FrameGraph(const FrameGraph&) = delete;
+	FrameGraph& operator=(const FrameGraph&) = delete;
+
+	Resource create_buffer(const std::string& name, const int width, const int height, const float clear = -std::numeric_limits<float>::max());
+	Resource create_image(const std::string& name, const int width, const int height, const int bpp);
+	void add_pass(const std::string& name, const std::vector<Resource>& reads, const std::vector<Resource>& writes, std::function<void()> run);
+	void output(const Resource image, const std::string& filename); // a pass writing the image to a tga file
+	void execute();
+
+	float* buffer(const Resource r);
+	TGAImage& image(const Resource r);
+	bool culled(const std::string& pass) const;
+	std::size_t memory() const;           // bytes allocated by execute()
+	std::size_t unaliased_memory() const; // bytes the resources it used would take each on its own
+private:
+	struct ResourceInfo {
+		std::string name;
+		int width;
+		int height;
+		int bpp; // 0 for a float buffer
+		float clear;
+		std::size_t slot;
+		std::vector<std::size_t> users; // passes that run, in order
+	};
+	struct Pass {
+		std::string name;
+		std::vector<Resource> reads;
+		std::vector<Resource> writes;
+		std::function<void()> run;
+		bool output;
+		bool culled;
+		std::vector<std::size_t> dependencies;
+		std::vector<Resource> creates; // resources to clear before running
+	};
+	struct Slot {
+		huge_vector<float> buffer;
+		TGAImage image;
+		std::vector<Resource> occupants;
+	};
+	ThreadPool& pool;
+	std::vector<ResourceInfo> resources;
+	std::vector<Pass> passes;
+	std::vector<Slot> slots;
+
+	void compile();
+	std::size_t bytes(const ResourceInfo& r) const;
+};
+
+#endif //__FRAME_GRAPH_H__
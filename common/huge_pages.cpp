@@ -0,0 +1,78 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "huge_pages.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+static HugePages mode_from_environment() {
+	const char* env = std::getenv("TINYRENDERER_HUGE_PAGES");
+	if (env && !std::strcmp(env, "off")) return HUGE_PAGES_OFF;
+	if (env && !std::strcmp(env, "explicit")) return HUGE_PAGES_EXPLICIT;
+	return HUGE_PAGES_TRANSPARENT;
+}
+
+static std::atomic<HugePages>& current_mode() {
+	static std::atomic<HugePages> mode(mode_from_environment());
+	return mode;
+}
+
+void set_huge_pages(const HugePages mode) {
+	current_mode() = mode;
+}
+
+HugePages huge_pages() {
+	return current_mode();
+}
+
+static std::size_t mapped_length(const std::size_t bytes) {
+	return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+}
+
+#ifdef __linux__
+// an anonymous mapping of length bytes starting on a huge page boundary: one huge page more is mapped and the
+// ends are trimmed off, the reserved pool is already aligned
+static void* map_huge(const std::size_t length, const HugePages mode) {
+#ifdef MAP_HUGETLB
+	if (mode == HUGE_PAGES_EXPLICIT) {
+		void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED) return p;
+	}
+#endif
+	void* p = mmap(nullptr, length + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) return nullptr;
+	std::uint8_t* base = static_cast<std::uint8_t*>(p);
+	std::uint8_t* aligned = reinterpret_cast<std::uint8_t*>((reinterpret_cast<std::uintptr_t>(base) + huge_page_size - 1) & ~(huge_page_size - 1));
+	if (aligned != base) munmap(base, aligned - base);
+	if (aligned + length != base + length + huge_page_size) munmap(aligned + length, base + huge_page_size - aligned);
+#if defined(MADV_HUGEPAGE) && defined(MADV_NOHUGEPAGE)
+	madvise(aligned, length, mode == HUGE_PAGES_OFF ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+#endif
+	return aligned;
+}
+#endif
+
+void* huge_allocate(const std::size_t bytes) {
+#ifdef __linux__
+	if (bytes >= huge_page_threshold) {
+		void* p = map_huge(mapped_length(bytes), huge_pages());
+		if (!p) throw std::bad_alloc();
+		return p;
+	}
+#endif
+	return ::operator new(bytes, std::align_val_t(cache_line_size));
+}
+
+void huge_deallocate(void* p, const std::size_t bytes) {
+	if (!p) return;
+#ifdef __linux__
+	if (bytes >= huge_page_threshold) {
+		munmap(p, mapped_length(bytes));
+		return;
+	}
+#endif
+	::operator delete(p, std::align_val_t(cache_line_size));
+}
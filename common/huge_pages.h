@@ -0,0 +1,44 @@
+#ifndef __HUGE_PAGES_H__
+#define __HUGE_PAGES_H__
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Memory for big pixel, depth and vertex arrays. Every block is aligned to a cache line; blocks of at least
+// huge_page_threshold bytes are mapped on their own at a 2MB boundary, so that a sweep over an 8K target or a
+// 4K texture goes through a few hundred TLB entries instead of tens of thousands of 4K ones:
+//   HUGE_PAGES_OFF          plain pages, even where the kernel would use huge ones for every mapping
+//   HUGE_PAGES_TRANSPARENT  madvise(MADV_HUGEPAGE), the kernel backs the block with huge pages when it can
+//   HUGE_PAGES_EXPLICIT     MAP_HUGETLB from the reserved pool, the transparent way when the pool is empty
+// The mode comes from the TINYRENDERER_HUGE_PAGES environment variable (off, transparent or explicit), transparent
+// when it isn't set, and set_huge_pages() overrides it for later blocks. Large blocks are rounded up to whole
+// huge pages. Outside Linux every block is an aligned operator new.
+enum HugePages { HUGE_PAGES_OFF, HUGE_PAGES_TRANSPARENT, HUGE_PAGES_EXPLICIT };
+
+const std::size_t huge_page_size = std::size_t(2) << 20;
+const std::size_t huge_page_threshold = 4 * huge_page_size;
+const std::size_t cache_line_size = 64;
+
+void set_huge_pages(const HugePages mode);
+HugePages huge_pages();
+void* huge_allocate(const std::size_t bytes); // throws std::bad_alloc
+void huge_deallocate(void* p, const std::size_t bytes);
+
+template<class T> struct HugePageAllocator {
+	typedef T value_type;
+	HugePageAllocator() noexcept {}
+	template<class U> HugePageAllocator(const HugePageAllocator<U>&) noexcept {}
+	T* allocate(const std::size_t n) {
+		static_assert(alignof(T) <= cache_line_size, "blocks are only aligned to a cache line");
+		return static_cast<T*>(huge_allocate(n * sizeof(T)));
+	}
+	void deallocate(T* p, const std::size_t n) noexcept { huge_deallocate(p, n * sizeof(T)); }
+};
+
+template<class T, class U> bool operator==(const HugePageAllocator<T>&, const HugePageAllocator<U>&) { return true; }
+template<class T, class U> bool operator!=(const HugePageAllocator<T>&, const HugePageAllocator<U>&) { return false; }
+
+template<class T> using huge_vector = std::vector<T, HugePageAllocator<T>>;
+
+#endif //__HUGE_PAGES_H__
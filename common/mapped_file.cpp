@@ -0,0 +1,115 @@
+#include <iostream>
+#include <algorithm>
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile() : ptr(nullptr), length(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) {}
+#else
+MappedFile::MappedFile() : ptr(nullptr), length(0) {}
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string filename) {
+	close();
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (INVALID_HANDLE_VALUE == file) {
+		std::cerr << "can't open file " << filename << "\n";
+		return false;
+	}
+	LARGE_INTEGER fsize;
+	if (!GetFileSizeEx(file, &fsize) || !fsize.QuadPart) {
+		std::cerr << "can't map an empty file " << filename << "\n";
+		close();
+		return false;
+	}
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping)
+		ptr = static_cast<const std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!ptr) {
+		std::cerr << "can't map file " << filename << "\n";
+		close();
+		return false;
+	}
+	length = static_cast<std::size_t>(fsize.QuadPart);
+	return true;
+}
+
+void MappedFile::discard(const std::size_t offset, const std::size_t length) const {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	const std::size_t page = info.dwPageSize;
+	const std::size_t first = (offset + page - 1) / page * page;
+	const std::size_t last = std::min(offset + length, this->length) / page * page;
+	if (ptr && first < last) VirtualUnlock(const_cast<std::uint8_t*>(ptr) + first, last - first); // unlocking pages that are not locked trims them
+}
+
+void MappedFile::close() {
+	if (ptr) UnmapViewOfFile(ptr);
+	if (mapping) CloseHandle(mapping);
+	if (INVALID_HANDLE_VALUE != file) CloseHandle(file);
+	ptr = nullptr;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+	length = 0;
+}
+#else
+bool MappedFile::open(const std::string filename) {
+	close();
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cerr << "can't open file " << filename << "\n";
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) || st.st_size <= 0) {
+		std::cerr << "can't map an empty file " << filename << "\n";
+		::close(fd);
+		return false;
+	}
+	void* p = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping keeps its own reference to the file
+	if (MAP_FAILED == p) {
+		std::cerr << "can't map file " << filename << "\n";
+		return false;
+	}
+	ptr = static_cast<const std::uint8_t*>(p);
+	length = static_cast<std::size_t>(st.st_size);
+	return true;
+}
+
+void MappedFile::discard(const std::size_t offset, const std::size_t length) const {
+	const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	const std::size_t first = (offset + page - 1) / page * page;
+	const std::size_t last = std::min(offset + length, this->length) / page * page;
+	if (ptr && first < last) madvise(const_cast<std::uint8_t*>(ptr) + first, last - first, MADV_DONTNEED); // clean file pages, read back from the file if touched again
+}
+
+void MappedFile::close() {
+	if (ptr) munmap(const_cast<std::uint8_t*>(ptr), length);
+	ptr = nullptr;
+	length = 0;
+}
+#endif
+
+const std::uint8_t* MappedFile::data() const {
+	return ptr;
+}
+
+std::size_t MappedFile::size() const {
+	return length;
+}
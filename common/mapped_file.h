@@ -0,0 +1,31 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Read-only mapping of a whole file. The pages are shared with the OS file cache and are only
+// faulted in when touched. The file must not be truncated or rewritten while it is mapped.
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string filename);
+	void close();
+	const std::uint8_t* data() const;
+	std::size_t size() const;
+	void discard(const std::size_t offset, const std::size_t length) const; // the range won't be read again soon, its whole pages may leave the working set
+private:
+	const std::uint8_t* ptr;
+	std::size_t length;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#endif
+};
+
+#endif //__MAPPED_FILE_H__
@@ -0,0 +1,167 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "packed_vertices.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PACKED_VERTICES_SSE2
+#endif
+
+static std::uint32_t float_bits(const float f) {
+	std::uint32_t u;
+	std::memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+static float bits_float(const std::uint32_t u) {
+	float f;
+	std::memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+// round to nearest even, overflows to infinity
+static std::uint16_t float_to_half(const float f) {
+	const std::uint32_t x = float_bits(f);
+	const std::uint16_t sign = (x >> 16) & 0x8000;
+	std::uint32_t a = x & 0x7fffffff;
+	if (a >= 0x7f800000) return sign | 0x7c00 | (a > 0x7f800000 ? 0x200 : 0);
+	if (a >= 0x477ff000) return sign | 0x7c00;                                                    // 65520 and up
+	if (a < 0x38800000) return sign | static_cast<std::uint16_t>(std::lrint(bits_float(a) * 16777216.f)); // subnormal, counts of 2^-24
+	a += 0xfff + ((a >> 13) & 1);
+	return sign | static_cast<std::uint16_t>((a - 0x38000000) >> 13);
+}
+
+#ifndef PACKED_VERTICES_SSE2
+static float half_to_float(const std::uint16_t h) {
+	const std::uint32_t em = static_cast<std::uint32_t>(h & 0x7fff) << 13;
+	std::uint32_t x = float_bits(bits_float(em) * bits_float(0x77800000)); // rebias the exponent by 2^112, subnormals included
+	if (em >= 0x0f800000) x |= 0x7f800000;                                 // infinity and nan
+	return bits_float(x | static_cast<std::uint32_t>(h & 0x8000) << 16);
+}
+#endif
+
+static void oct_decode(const std::int16_t* q, float* n) {
+	float x = std::max(q[0] * (1.f / 32767.f), -1.f);
+	float y = std::max(q[1] * (1.f / 32767.f), -1.f);
+	const float z = 1.f - (std::abs(x) + std::abs(y));
+	const float t = std::max(-z, 0.f); // the lower hemisphere is folded over the diagonals
+	x += x >= 0 ? -t : t;
+	y += y >= 0 ? -t : t;
+	const float l = std::sqrt(x * x + y * y + z * z);
+	n[0] = x / l;
+	n[1] = y / l;
+	n[2] = z / l;
+}
+
+// projects onto the octahedron |x|+|y|+|z| = 1 and unfolds it into a square, then keeps whichever of the four
+// neighbouring grid points decodes closest to n rather than the nearest one
+static void oct_encode(const float* n, std::int16_t* q) {
+	const float l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+	if (l1 <= 0) {
+		q[0] = q[1] = 0;
+		return;
+	}
+	float x = n[0] / l1;
+	float y = n[1] / l1;
+	if (n[2] < 0) {
+		const float fx = (1.f - std::abs(y)) * (x >= 0 ? 1.f : -1.f);
+		const float fy = (1.f - std::abs(x)) * (y >= 0 ? 1.f : -1.f);
+		x = fx;
+		y = fy;
+	}
+	const float fx = std::floor(std::min(std::max(x, -1.f), 1.f) * 32767.f);
+	const float fy = std::floor(std::min(std::max(y, -1.f), 1.f) * 32767.f);
+	double best = 8.;
+	for (int i = 0; i < 4; i++) {
+		const std::int16_t c[2] = { static_cast<std::int16_t>(std::min(fx + (i & 1), 32767.f)), static_cast<std::int16_t>(std::min(fy + (i >> 1), 32767.f)) };
+		float d[3];
+		oct_decode(c, d);
+		double err = 0; // a float dot product rounds to 1 for all four
+		for (int k = 0; k < 3; k++) err += (double(d[k]) - n[k]) * (double(d[k]) - n[k]);
+		if (err < best) {
+			best = err;
+			q[0] = c[0];
+			q[1] = c[1];
+		}
+	}
+}
+
+PackedVertices::PackedVertices() : vertices(), offset(), scale() {}
+
+void PackedVertices::encode(const float* positions, const float* uvs, const float* normals, const std::size_t count, const float* bbox_min, const float* bbox_max) {
+	for (int i = 0; i < 3; i++) {
+		offset[i] = bbox_min[i];
+		scale[i] = bbox_max[i] > bbox_min[i] ? (bbox_max[i] - bbox_min[i]) / 65535.f : 0.f;
+	}
+	offset[3] = scale[3] = 0.f;
+	vertices.assign(count, Vertex());
+	for (std::size_t v = 0; v < count; v++) {
+		Vertex& out = vertices[v];
+		for (int i = 0; i < 3; i++) {
+			const float t = scale[i] > 0 ? (positions[v * 3 + i] - offset[i]) / scale[i] : 0.f;
+			out.position[i] = static_cast<std::uint16_t>(std::lrint(std::min(std::max(t, 0.f), 65535.f)));
+		}
+		out.uv[0] = float_to_half(uvs[v * 2]);
+		out.uv[1] = float_to_half(uvs[v * 2 + 1]);
+		oct_encode(normals + v * 3, out.normal);
+	}
+}
+
+void PackedVertices::position(const std::size_t i, float* xyz) const {
+#ifdef PACKED_VERTICES_SSE2
+	const __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(&vertices[i]));
+	const __m128 p = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128())), _mm_load_ps(scale)), _mm_load_ps(offset));
+	_mm_storel_pi(reinterpret_cast<__m64*>(xyz), p);
+	_mm_store_ss(xyz + 2, _mm_movehl_ps(p, p));
+#else
+	for (int k = 0; k < 3; k++) xyz[k] = vertices[i].position[k] * scale[k] + offset[k];
+#endif
+}
+
+void PackedVertices::uv(const std::size_t i, float* uv) const {
+#ifdef PACKED_VERTICES_SSE2
+	const __m128i h = _mm_unpackhi_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(&vertices[i])), _mm_setzero_si128());
+	const __m128i em = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+	const __m128i special = _mm_and_si128(_mm_cmpgt_epi32(em, _mm_set1_epi32(0x0f7fffff)), _mm_set1_epi32(0x7f800000));
+	const __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+	__m128 f = _mm_mul_ps(_mm_castsi128_ps(em), _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+	f = _mm_or_ps(f, _mm_castsi128_ps(_mm_or_si128(special, sign)));
+	_mm_storel_pi(reinterpret_cast<__m64*>(uv), f);
+#else
+	uv[0] = half_to_float(vertices[i].uv[0]);
+	uv[1] = half_to_float(vertices[i].uv[1]);
+#endif
+}
+
+void PackedVertices::normal(const std::size_t i, float* xyz) const {
+#ifdef PACKED_VERTICES_SSE2
+	const __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(&vertices[i]));
+	const __m128i q = _mm_shuffle_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16), _MM_SHUFFLE(3, 3, 3, 2));
+	const __m128 signbit = _mm_set1_ps(-0.f);
+	const __m128 xy = _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(q), _mm_set1_ps(1.f / 32767.f)), _mm_set1_ps(-1.f));
+	const __m128 a = _mm_andnot_ps(signbit, xy);
+	const __m128 z = _mm_sub_ps(_mm_set1_ps(1.f), _mm_add_ps(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 1))));
+	const __m128 t = _mm_shuffle_ps(_mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), z), _mm_setzero_ps()), z, 0);
+	const __m128 n = _mm_movelh_ps(_mm_sub_ps(xy, _mm_or_ps(t, _mm_and_ps(xy, signbit))), _mm_move_ss(_mm_setzero_ps(), z));
+	const __m128 sq = _mm_mul_ps(n, n);
+	const __m128 l = _mm_sqrt_ss(_mm_add_ss(_mm_add_ss(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 1, 1, 1))), _mm_movehl_ps(sq, sq)));
+	const __m128 r = _mm_div_ps(n, _mm_shuffle_ps(l, l, 0));
+	_mm_storel_pi(reinterpret_cast<__m64*>(xyz), r);
+	_mm_store_ss(xyz + 2, _mm_movehl_ps(r, r));
+#else
+	oct_decode(vertices[i].normal, xyz);
+#endif
+}
+
+std::size_t PackedVertices::size() const {
+	return vertices.size();
+}
+
+std::size_t PackedVertices::memory() const {
+	return vertices.size() * sizeof(Vertex);
+}
+
+bool PackedVertices::empty() const {
+	return vertices.empty();
+}
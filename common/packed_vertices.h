@@ -0,0 +1,36 @@
+#ifndef __PACKED_VERTICES_H__
+#define __PACKED_VERTICES_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "huge_pages.h"
+
+// Compact vertex storage, 16 bytes per vertex instead of 32 for float position, uv and normal.
+// Positions are 16-bit fixed point over the mesh bounding box (off by about 1/131070 of its extent),
+// uvs are half floats (off by up to 2^-12 near 1) and unit normals are octahedral maps in two 16-bit
+// snorms (within 0.0025 degrees). Decoding is SSE2 when available, with bit-identical scalar fallback.
+// Arrays are passed as interleaved floats: xyz for positions and normals, uv for uvs.
+class PackedVertices {
+public:
+	PackedVertices();
+	void encode(const float* positions, const float* uvs, const float* normals, const std::size_t count, const float* bbox_min, const float* bbox_max);
+	void position(const std::size_t i, float* xyz) const;
+	void uv(const std::size_t i, float* uv) const;
+	void normal(const std::size_t i, float* xyz) const;
+	std::size_t size() const;
+	std::size_t memory() const;
+	bool empty() const;
+private:
+	struct alignas(16) Vertex {
+		std::uint16_t position[3];
+		std::uint16_t pad;
+		std::uint16_t uv[2];    // IEEE half
+		std::int16_t normal[2]; // octahedral
+	};
+	huge_vector<Vertex> vertices;
+	alignas(16) float offset[4];
+	alignas(16) float scale[4];
+};
+
+#endif //__PACKED_VERTICES_H__
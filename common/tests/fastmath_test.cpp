@@ -0,0 +1,161 @@
+// Sweeps every fastmath.h function at every precision tier over its documented domain, compares it with double
+// precision libm and times it next to the float libm function. Build it with vectorization on, as the shaders are:
+//   g++ -std=c++17 -O3 -I.. fastmath_test.cpp -o fastmath_test
+// and run it; it returns 1 when an error is above the table at the top of fastmath.h.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "fastmath.h"
+
+enum Function { ATAN, ACOS, SIN, COS, EXP2, LOG2, POW, RSQRT, FUNCTIONS };
+
+const char* const names[FUNCTIONS] = { "atan", "acos", "sin", "cos", "exp2", "log2", "pow", "rsqrt" };
+
+// the table in fastmath.h, one column per FastPrecision
+const double documented[FUNCTIONS][3] = {
+	{ 6.1e-4, 1.2e-5, 1.7e-7 },
+	{ 3.3e-4, 5.1e-6, 3.5e-7 },
+	{ 1.6e-4, 6.4e-7, 8.8e-8 },
+	{ 1.6e-4, 6.4e-7, 8.8e-8 },
+	{ 7.5e-5, 2.4e-7, 1.1e-7 },
+	{ 9.5e-5, 2.1e-6, 9.7e-8 },
+	{ 3.4e-3, 7.4e-5, 7.8e-6 },
+	{ 1.8e-3, 4.8e-6, 9.0e-8 },
+};
+
+// Calls f on every stride-th float of [lo, hi) in bit order, which is dense near 0 and in every binade, and on n
+// evenly spaced ones. Negative values are walked by magnitude.
+template<class F> static void for_floats(const float lo, const float hi, const std::uint32_t stride, F f) {
+	const std::uint32_t top = fast_float_bits(hi);
+	for (std::uint32_t bits = fast_float_bits(std::max(lo, 0.f)); lo < hi && bits < top; bits += stride)
+		f(fast_bits_float(bits));
+	if (lo < 0)
+		for (std::uint32_t bits = fast_float_bits(std::max(-hi, 0.f)) + 1, end = fast_float_bits(-lo); bits <= end; bits += stride)
+			f(-fast_bits_float(bits));
+	const int n = 1 << 20;
+	for (int i = 0; i < n; i++)
+		f(lo * (1 - i / float(n)) + hi * (i / float(n)));
+}
+
+static double absolute_error(const float x, const double ref) {
+	return std::abs(x - ref);
+}
+
+static double relative_error(const float x, const double ref) {
+	return std::abs(x - ref) / std::abs(ref);
+}
+
+// the largest errors of tier P, in the order of Function
+template<FastPrecision P> static void measure(double (&error)[FUNCTIONS]) {
+	const std::uint32_t stride = 251;
+	const float largest = fast_bits_float(0x7f7fffff), smallest = fast_bits_float(0x00800000);
+	std::fill(error, error + FUNCTIONS, 0.);
+	for_floats(-largest, largest, stride, [&](float x) {
+		error[ATAN] = std::max(error[ATAN], absolute_error(fast_atan<P>(x), std::atan(double(x))));
+	});
+	for_floats(-1.f, std::nextafter(1.f, 2.f), stride, [&](float x) {
+		error[ACOS] = std::max(error[ACOS], absolute_error(fast_acos<P>(x), std::acos(double(x))));
+	});
+	for_floats(-8192.f, 8192.f, stride, [&](float x) {
+		error[SIN] = std::max(error[SIN], absolute_error(fast_sin<P>(x), std::sin(double(x))));
+		error[COS] = std::max(error[COS], absolute_error(fast_cos<P>(x), std::cos(double(x))));
+	});
+	for_floats(-125.f, 128.f, stride, [&](float x) {
+		error[EXP2] = std::max(error[EXP2], relative_error(fast_exp2<P>(x), std::exp2(double(x))));
+	});
+	for_floats(smallest, largest, stride, [&](float x) {
+		const double ref = std::log2(double(x));
+		error[LOG2] = std::max(error[LOG2], absolute_error(fast_log2<P>(x), ref) / std::max(1., std::abs(ref)));
+		error[RSQRT] = std::max(error[RSQRT], relative_error(fast_rsqrt<P>(x), 1. / std::sqrt(double(x))));
+	});
+	// x over the normal floats, y from -50 to 50 as long as x^y stays clear of the exp2 clamp
+	for_floats(smallest, largest, 1 << 16, [&](float x) {
+		for (int i = -200; i <= 200; i++) {
+			const float y = i / 4.f;
+			const double exponent = y * std::log2(double(x));
+			if (exponent < -124 || exponent > 127) continue;
+			error[POW] = std::max(error[POW], relative_error(fast_pow<P>(x, y), std::pow(double(x), double(y))));
+		}
+	});
+	if (fast_pow<P>(0.f, 0.f) != 1.f || fast_pow<P>(0.f, 2.f) != 0.f || fast_pow<P>(0.f, -2.f) != 0.f)
+		error[POW] = INFINITY;
+}
+
+volatile float sink;
+
+// nanoseconds per value of out[i] = f(x[i], y[i]) over the arrays
+template<class F> static double time_values(const std::vector<float>& x, const std::vector<float>& y, std::vector<float>& out, F f) {
+	const int repeats = 16;
+	const std::size_t n = x.size();
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < repeats; r++)
+		for (std::size_t i = 0; i < n; i++) out[i] = f(x[i], y[i]);
+	sink = out[n / 2];
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (repeats * n);
+}
+
+static std::vector<float> random_floats(const std::size_t n, const float lo, const float hi) {
+	std::vector<float> ret(n);
+	for (float& v : ret) v = lo + (hi - lo) * (rand() / float(RAND_MAX));
+	return ret;
+}
+
+template<FastPrecision P> static void time_tier(double (&ns)[FUNCTIONS], const std::vector<float>* x, const std::vector<float>& y, std::vector<float>& out) {
+	ns[ATAN] = time_values(x[ATAN], y, out, [](float a, float) { return fast_atan<P>(a); });
+	ns[ACOS] = time_values(x[ACOS], y, out, [](float a, float) { return fast_acos<P>(a); });
+	ns[SIN] = time_values(x[SIN], y, out, [](float a, float) { return fast_sin<P>(a); });
+	ns[COS] = time_values(x[COS], y, out, [](float a, float) { return fast_cos<P>(a); });
+	ns[EXP2] = time_values(x[EXP2], y, out, [](float a, float) { return fast_exp2<P>(a); });
+	ns[LOG2] = time_values(x[LOG2], y, out, [](float a, float) { return fast_log2<P>(a); });
+	ns[POW] = time_values(x[POW], y, out, [](float a, float b) { return fast_pow<P>(a, b); });
+	ns[RSQRT] = time_values(x[RSQRT], y, out, [](float a, float) { return fast_rsqrt<P>(a); });
+}
+
+int main() {
+	double error[3][FUNCTIONS];
+	measure<FAST_LOW>(error[FAST_LOW]);
+	measure<FAST_MEDIUM>(error[FAST_MEDIUM]);
+	measure<FAST_HIGH>(error[FAST_HIGH]);
+
+	int failures = 0;
+	printf("max error, measured / documented\n");
+	printf("          FAST_LOW             FAST_MEDIUM          FAST_HIGH\n");
+	for (int f = 0; f < FUNCTIONS; f++) {
+		printf("%-6s", names[f]);
+		for (int p = 0; p < 3; p++) {
+			const bool fail = !(error[p][f] <= documented[f][p]);
+			printf("    %7.1e / %7.1e%s", error[p][f], documented[f][p], fail ? "!" : " ");
+			failures += fail;
+		}
+		printf("\n");
+	}
+
+	const std::size_t n = 1 << 20;
+	const std::vector<float> x[FUNCTIONS] = {
+		random_floats(n, -10, 10), random_floats(n, -1, 1), random_floats(n, -100, 100), random_floats(n, -100, 100),
+		random_floats(n, -20, 20), random_floats(n, 1e-3f, 100), random_floats(n, 1e-3f, 4), random_floats(n, 1e-3f, 100),
+	};
+	const std::vector<float> y = random_floats(n, 0, 8);
+	std::vector<float> out(n);
+	double ns[4][FUNCTIONS];
+	ns[0][ATAN] = time_values(x[ATAN], y, out, [](float a, float) { return std::atan(a); });
+	ns[0][ACOS] = time_values(x[ACOS], y, out, [](float a, float) { return std::acos(a); });
+	ns[0][SIN] = time_values(x[SIN], y, out, [](float a, float) { return std::sin(a); });
+	ns[0][COS] = time_values(x[COS], y, out, [](float a, float) { return std::cos(a); });
+	ns[0][EXP2] = time_values(x[EXP2], y, out, [](float a, float) { return std::exp2(a); });
+	ns[0][LOG2] = time_values(x[LOG2], y, out, [](float a, float) { return std::log2(a); });
+	ns[0][POW] = time_values(x[POW], y, out, [](float a, float b) { return std::pow(a, b); });
+	ns[0][RSQRT] = time_values(x[RSQRT], y, out, [](float a, float) { return 1.f / std::sqrt(a); });
+	time_tier<FAST_LOW>(ns[1], x, y, out);
+	time_tier<FAST_MEDIUM>(ns[2], x, y, out);
+	time_tier<FAST_HIGH>(ns[3], x, y, out);
+
+	printf("\nns per value over %zu floats\n", n);
+	printf("          libm    FAST_LOW  FAST_MEDIUM  FAST_HIGH\n");
+	for (int f = 0; f < FUNCTIONS; f++)
+		printf("%-6s  %6.2f      %6.2f       %6.2f     %6.2f\n", names[f], ns[0][f], ns[1][f], ns[2][f], ns[3][f]);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+// Checks and times the vec4f and Matrix operators of a lesson's geometry.h against plain scalar loops that do what
+// the generic templates do, in the same order. Build it against the lesson to check, for example
+//   g++ -std=c++17 -O2 -I"../../lesson 8b - AO screenspace" geometry_bench.cpp -o geometry_bench
+// and run it; it returns 1 when a result differs from the scalar one.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "geometry.h"
+
+static float random_float() {
+	return rand() / float(RAND_MAX) * 2.f - 1.f;
+}
+
+// the generic templates: dot products summed from the last component down, starting from 0
+static vec4f scalar_mul(const Matrix& m, const vec4f& v) {
+	vec4f ret;
+	for (size_t i = 4; i--;) {
+		float res = 0;
+		for (size_t k = 4; k--; res += m[i][k] * v[k]);
+		ret[i] = res;
+	}
+	return ret;
+}
+
+// each entry the dot product of a row and a copy of a column, as mat::col() hands it out
+template<size_t C> static mat<4, C, float> scalar_mul(const Matrix& lhs, const mat<4, C, float>& rhs) {
+	mat<4, C, float> ret;
+	for (size_t i = 4; i--;)
+		for (size_t j = C; j--;) {
+			float col[4], res = 0;
+			for (size_t k = 4; k--; col[k] = rhs[k][j]);
+			for (size_t k = 4; k--; res += lhs[i][k] * col[k]);
+			ret[i][j] = res;
+		}
+	return ret;
+}
+
+template<size_t R, size_t C> static mat<C, R, float> scalar_transpose(const mat<R, C, float>& m) {
+	mat<C, R, float> ret;
+	for (size_t i = R; i--;)
+		for (size_t j = C; j--; ret[j][i] = m[i][j]);
+	return ret;
+}
+
+template<size_t R, size_t C> static bool same(const mat<R, C, float>& a, const mat<R, C, float>& b) {
+	for (size_t i = R; i--;)
+		for (size_t j = C; j--;)
+			if (std::memcmp(&a[i][j], &b[i][j], sizeof(float))) return false;
+	return true;
+}
+
+static bool same(const vec4f& a, const vec4f& b) {
+	for (size_t i = 4; i--;)
+		if (std::memcmp(&a[i], &b[i], sizeof(float))) return false;
+	return true;
+}
+
+volatile float sink;
+
+// nanoseconds per call of f(i) over iters calls
+template<class F> static double bench(const int iters, F f) {
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iters; i++) f(i);
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iters;
+}
+
+int main() {
+	const int n = 1 << 12, checks = 200000, iters = 1 << 22;
+	std::vector<Matrix> ms(n);
+	std::vector<vec4f> vs(n);
+	std::vector<mat<4, 3, float>> ts(n);
+	for (int i = 0; i < n; i++)
+		for (int r = 0; r < 4; r++) {
+			vs[i][r] = random_float();
+			for (int c = 0; c < 4; c++) ms[i][r][c] = random_float();
+			for (int c = 0; c < 3; c++) ts[i][r][c] = random_float();
+		}
+
+	int failures = 0;
+	for (int i = 0; i < checks; i++) {
+		const Matrix& m = ms[i % n];
+		const Matrix& m2 = ms[(i * 7 + 1) % n];
+		const vec4f& v = vs[(i * 3 + 2) % n];
+		const mat<4, 3, float>& t = ts[(i * 5 + 3) % n];
+		failures += !same(m * v, scalar_mul(m, v));
+		failures += !same(m * m2, scalar_mul(m, m2));
+		failures += !same(m.transpose(), scalar_transpose(m));
+		failures += !same((m * t).transpose(), scalar_transpose(scalar_mul(m, t)));
+	}
+	printf("%d random inputs, %d results differ from the scalar ones\n", checks, failures);
+
+	printf("ns per call           scalar    geometry.h\n");
+	const int mask = n - 1;
+	printf("mat*vec              %7.2f    %7.2f\n",
+		bench(iters, [&](int i) { sink = scalar_mul(ms[i & mask], vs[(i * 7) & mask])[i & 3]; }),
+		bench(iters, [&](int i) { sink = (ms[i & mask] * vs[(i * 7) & mask])[i & 3]; }));
+	printf("mat*mat              %7.2f    %7.2f\n",
+		bench(iters, [&](int i) { sink = scalar_mul(ms[i & mask], ms[(i * 7) & mask])[i & 3][1]; }),
+		bench(iters, [&](int i) { sink = (ms[i & mask] * ms[(i * 7) & mask])[i & 3][1]; }));
+	printf("transpose            %7.2f    %7.2f\n",
+		bench(iters, [&](int i) { sink = scalar_transpose(ms[i & mask])[i & 3][2]; }),
+		bench(iters, [&](int i) { sink = ms[i & mask].transpose()[i & 3][2]; }));
+	printf("(Viewport*clipc)^T   %7.2f    %7.2f\n",
+		bench(iters, [&](int i) { sink = scalar_transpose(scalar_mul(ms[i & mask], ts[(i * 7) & mask]))[i % 3][i & 3]; }),
+		bench(iters, [&](int i) { sink = (ms[i & mask] * ts[(i * 7) & mask]).transpose()[i % 3][i & 3]; }));
+	return failures ? 1 : 0;
+}
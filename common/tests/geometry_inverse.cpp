@@ -0,0 +1,131 @@
+// Checks and times the closed-form invert(), invert_transpose() and invert_affine() of a lesson's geometry.h for 3x3
+// and 4x4 float matrices against the cofactor recursion they replaced. Build it against the lesson to check, e.g.
+//   g++ -std=c++17 -O2 -I"../../lesson 8b - AO screenspace" geometry_inverse.cpp -o geometry_inverse
+// and run it; it returns 1 when an inverse is off by more than max_error.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "geometry.h"
+
+const double max_error = 1e-4;
+
+static float random_float() {
+	return rand() / float(RAND_MAX) * 2.f - 1.f;
+}
+
+// random entries in [-1,1], away from singular; affine ones get a last row of 0 ... 0 1
+template<size_t N> static mat<N, N, float> random_matrix(const bool affine) {
+	mat<N, N, float> m;
+	do {
+		for (size_t i = N; i--;)
+			for (size_t j = N; j--; m[i][j] = random_float());
+		if (affine)
+			for (size_t j = N; j--; m[N - 1][j] = j + 1 == N);
+	} while (std::abs(m.det()) < .05f);
+	return m;
+}
+
+template<size_t N> static mat<N, N, double> to_double(const mat<N, N, float>& m) {
+	mat<N, N, double> ret;
+	for (size_t i = N; i--;)
+		for (size_t j = N; j--; ret[i][j] = m[i][j]);
+	return ret;
+}
+
+// what invert_transpose() did before the inv<> specializations: adjugate() expands every cofactor through dt<>
+template<size_t N, typename T> static mat<N, N, T> recursive_invert_transpose(const mat<N, N, T>& m) {
+	mat<N, N, T> adj = m.adjugate();
+	return adj / (adj[0] * m[0]);
+}
+
+// the largest entry of |m * x - I|, summed in double
+template<size_t N> static double identity_error(const mat<N, N, float>& m, const mat<N, N, float>& x) {
+	double ret = 0;
+	for (size_t i = N; i--;)
+		for (size_t j = N; j--;) {
+			double sum = 0;
+			for (size_t k = N; k--; sum += double(m[i][k]) * x[k][j]);
+			ret = std::max(ret, std::abs(sum - (i == j)));
+		}
+	return ret;
+}
+
+// the largest entry of |x - ref| over the largest entry of |ref|
+template<size_t N> static double scaled_error(const mat<N, N, float>& x, const mat<N, N, double>& ref) {
+	double diff = 0, scale = 0;
+	for (size_t i = N; i--;)
+		for (size_t j = N; j--;) {
+			diff = std::max(diff, std::abs(x[i][j] - ref[i][j]));
+			scale = std::max(scale, std::abs(ref[i][j]));
+		}
+	return diff / scale;
+}
+
+struct Errors {
+	double identity = 0, scaled = 0;
+	void add(const double id, const double sc) {
+		identity = std::max(identity, id);
+		scaled = std::max(scaled, sc);
+	}
+};
+
+volatile float sink;
+
+// nanoseconds per call of f(i) over iters calls
+template<class F> static double bench(const int iters, F f) {
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iters; i++) f(i);
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iters;
+}
+
+template<size_t N> static bool check(const int checks) {
+	Errors inverse, inverse_transpose, affine;
+	for (int n = 0; n < checks; n++) {
+		const mat<N, N, float> m = random_matrix<N>(false), a = random_matrix<N>(true);
+		const mat<N, N, double> ref = recursive_invert_transpose(to_double(m)).transpose();
+		const mat<N, N, double> ref_affine = recursive_invert_transpose(to_double(a)).transpose();
+		const mat<N, N, float> x = m.invert(), xt = m.invert_transpose(), xa = a.invert_affine();
+		inverse.add(identity_error(m, x), scaled_error(x, ref));
+		inverse_transpose.add(identity_error(m, xt.transpose()), scaled_error(xt, ref.transpose()));
+		affine.add(identity_error(a, xa), scaled_error(xa, ref_affine));
+	}
+	printf("%zux%zu, max over %d random matrices  |M*X - I|    |X - ref| / |ref|\n", N, N, checks);
+	printf("invert                               %9.2e    %9.2e\n", inverse.identity, inverse.scaled);
+	printf("invert_transpose                     %9.2e    %9.2e\n", inverse_transpose.identity, inverse_transpose.scaled);
+	printf("invert_affine                        %9.2e    %9.2e\n", affine.identity, affine.scaled);
+	const Errors* all[] = { &inverse, &inverse_transpose, &affine };
+	bool ok = true;
+	for (const Errors* e : all) ok = ok && e->identity <= max_error && e->scaled <= max_error;
+	return ok;
+}
+
+template<size_t N> static void time_inverses(const int iters) {
+	const int n = 1 << 10, mask = n - 1;
+	std::vector<mat<N, N, float>> ms(n), as(n);
+	for (int i = 0; i < n; i++) {
+		ms[i] = random_matrix<N>(false);
+		as[i] = random_matrix<N>(true);
+	}
+	const double recursion_transpose = bench(iters, [&](int i) { sink = recursive_invert_transpose(ms[i & mask])[i % N][1]; });
+	const double recursion = bench(iters, [&](int i) { sink = recursive_invert_transpose(ms[i & mask]).transpose()[i % N][1]; });
+	const double recursion_affine = bench(iters, [&](int i) { sink = recursive_invert_transpose(as[i & mask]).transpose()[i % N][1]; });
+	const double closed = bench(iters, [&](int i) { sink = ms[i & mask].invert()[i % N][1]; });
+	const double closed_transpose = bench(iters, [&](int i) { sink = ms[i & mask].invert_transpose()[i % N][1]; });
+	const double closed_affine = bench(iters, [&](int i) { sink = as[i & mask].invert_affine()[i % N][1]; });
+	printf("%zux%zu, ns per call    recursion   geometry.h   speedup\n", N, N);
+	printf("invert               %9.2f    %9.2f    %5.1fx\n", recursion, closed, recursion / closed);
+	printf("invert_transpose     %9.2f    %9.2f    %5.1fx\n", recursion_transpose, closed_transpose, recursion_transpose / closed_transpose);
+	printf("invert_affine        %9.2f    %9.2f    %5.1fx\n", recursion_affine, closed_affine, recursion_affine / closed_affine);
+}
+
+int main() {
+	const int checks = 200000, iters = 1 << 20;
+	const bool ok = check<3>(checks) & check<4>(checks);
+	time_inverses<3>(iters);
+	time_inverses<4>(iters);
+	if (!ok) printf("error above %g\n", max_error);
+	return ok ? 0 : 1;
+}
@@ -1,53 +1,79 @@
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <thread>
 #include "tgaimage.h"
+#include "thread_pool.h"
 
-TGAImage::TGAImage() : data(), width(0), height(0), bytespp(0) {}
-TGAImage::TGAImage(const int w, const int h, const int bpp) : data(w* h* bpp, 0), width(w), height(h), bytespp(bpp) {}
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TGAIMAGE_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+TGAImage::TGAImage() : data(), external(nullptr), width(0), height(0), bytespp(0), mapping(), origin(0), stride(0), step(0) {}
+TGAImage::TGAImage(const int w, const int h, const int bpp) : data(w* h* bpp, 0), external(nullptr), width(w), height(h), bytespp(bpp), mapping(), origin(0), stride(w* bpp), step(bpp) {}
+
+TGAImage::TGAImage(const int w, const int h, const int bpp, std::uint8_t* storage) : data(), external(storage), width(w), height(h), bytespp(bpp), mapping(), origin(0), stride(w* bpp), step(bpp) {
+	memset(external, 0, static_cast<size_t>(w) * h * bpp);
+}
+
+TGAImage::TGAImage(const TGAImage& img) : data(img.data), external(nullptr), width(img.width), height(img.height), bytespp(img.bytespp), mapping(img.mapping), origin(img.origin), stride(img.stride), step(img.step) {
+	if (img.external) data.assign(img.external, img.external + static_cast<size_t>(width) * height * bytespp);
+}
+
+TGAImage& TGAImage::operator=(const TGAImage& img) {
+	if (this != &img) *this = TGAImage(img);
+	return *this;
+}
+
+// pixel data follows the header, the image id and the (unused) color map
+static size_t payload_offset(const TGA_Header& header) {
+	return sizeof(header) + header.idlength + (header.colormaptype ? header.colormaplength * ((header.colormapdepth + 7) >> 3) : 0);
+}
 
 bool TGAImage::read_tga_file(const std::string filename) {
-	std::ifstream in;
-	in.open(filename, std::ios::binary);
-	if (!in.is_open()) {
-		std::cerr << "can't open file " << filename << "\n";
-		in.close();
+	MappedFile file;
+	if (!file.open(filename))
 		return false;
-	}
 	TGA_Header header;
-	in.read(reinterpret_cast<char*>(&header), sizeof(header));
-	if (!in.good()) {
-		in.close();
+	if (file.size() < sizeof(header)) {
 		std::cerr << "an error occured while reading the header\n";
 		return false;
 	}
+	memcpy(&header, file.data(), sizeof(header));
 	width = header.width;
 	height = header.height;
 	bytespp = header.bitsperpixel >> 3;
 	if (width <= 0 || height <= 0 || (bytespp != GRAYSCALE && bytespp != RGB && bytespp != RGBA)) {
-		in.close();
 		std::cerr << "bad bpp (or width/height) value\n";
 		return false;
 	}
 	size_t nbytes = bytespp * width * height;
-	data = std::vector<std::uint8_t>(nbytes, 0);
+	data = huge_vector<std::uint8_t>(nbytes, 0);
+	external = nullptr;
+	mapping.reset();
+	origin = 0;
+	stride = width * bytespp;
+	step = bytespp;
+	const std::uint8_t* in = file.data() + std::min(payload_offset(header), file.size());
+	const std::uint8_t* end = file.data() + file.size();
 	if (3 == header.datatypecode || 2 == header.datatypecode) {
-		in.read(reinterpret_cast<char*>(data.data()), nbytes);
-		if (!in.good()) {
-			in.close();
+		if (static_cast<size_t>(end - in) < nbytes) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
+		memcpy(data.data(), in, nbytes);
 	}
 	else if (10 == header.datatypecode || 11 == header.datatypecode) {
-		if (!load_rle_data(in)) {
-			in.close();
+		if (!load_rle_data(in, end)) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
 	}
 	else {
-		in.close();
 		std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
 		return false;
 	}
@@ -56,61 +82,116 @@ bool TGAImage::read_tga_file(const std::string filename) {
 	if (header.imagedescriptor & 0x10)
 		flip_horizontally();
 	std::cerr << width << "x" << height << "/" << bytespp * 8 << "\n";
-	in.close();
 	return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream& in) {
-	size_t pixelcount = width * height;
-	size_t currentpixel = 0;
-	size_t currentbyte = 0;
-	TGAColor colorbuffer;
-	do {
-		std::uint8_t chunkheader = 0;
-		chunkheader = in.get();
-		if (!in.good()) {
+bool TGAImage::map_tga_file(const std::string filename) {
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!file->open(filename))
+		return false;
+	TGA_Header header;
+	if (file->size() < sizeof(header)) {
+		std::cerr << "an error occured while reading the header\n";
+		return false;
+	}
+	memcpy(&header, file->data(), sizeof(header));
+	// only uncompressed images can be sampled in place, the rest is decoded as usual
+	if (3 != header.datatypecode && 2 != header.datatypecode) {
+		file.reset();
+		return read_tga_file(filename);
+	}
+	const int w = header.width;
+	const int h = header.height;
+	const int bpp = header.bitsperpixel >> 3;
+	if (w <= 0 || h <= 0 || (bpp != GRAYSCALE && bpp != RGB && bpp != RGBA)) {
+		std::cerr << "bad bpp (or width/height) value\n";
+		return false;
+	}
+	const size_t linebytes = w * bpp;
+	const size_t offset = payload_offset(header);
+	if (offset + linebytes * h > file->size()) {
+		std::cerr << "an error occured while reading the data\n";
+		return false;
+	}
+	data = huge_vector<std::uint8_t>();
+	external = nullptr;
+	mapping = file;
+	width = w;
+	height = h;
+	bytespp = bpp;
+	origin = offset;
+	stride = linebytes;
+	step = bpp;
+	if (!(header.imagedescriptor & 0x20))
+		flip_vertically();
+	if (header.imagedescriptor & 0x10)
+		flip_horizontally();
+	std::cerr << width << "x" << height << "/" << bytespp * 8 << " (mapped)\n";
+	return true;
+}
+
+// fills n pixels with the color at p
+static void expand_run(std::uint8_t* out, const std::uint8_t* p, const size_t n, const int bytespp) {
+	if (1 == bytespp) {
+		memset(out, *p, n);
+		return;
+	}
+	size_t i = 0;
+#ifdef TGAIMAGE_SSE2
+	if (4 == bytespp) {
+		std::uint32_t c;
+		memcpy(&c, p, 4);
+		const __m128i v = _mm_set1_epi32(static_cast<int>(c));
+		for (; i + 4 <= n; i += 4)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), v);
+	}
+#endif
+	if (i == n) return;
+	// double the filled prefix until the run is complete: at most 8 copies for a 128 pixel run
+	std::uint8_t* dst = out + i * bytespp;
+	const size_t total = (n - i) * bytespp;
+	memcpy(dst, p, bytespp);
+	for (size_t filled = bytespp; filled < total; filled <<= 1)
+		memcpy(dst + filled, dst, std::min(filled, total - filled));
+}
+
+bool TGAImage::load_rle_data(const std::uint8_t* in, const std::uint8_t* end) {
+	std::uint8_t* out = data.data();
+	std::uint8_t* const out_end = out + data.size();
+	while (out < out_end) {
+		if (in >= end) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
-		if (chunkheader < 128) {
-			chunkheader++;
-			for (int i = 0; i < chunkheader; i++) {
-				in.read(reinterpret_cast<char*>(colorbuffer.bgra), bytespp);
-				if (!in.good()) {
-					std::cerr << "an error occured while reading the header\n";
-					return false;
-				}
-				for (int t = 0; t < bytespp; t++)
-					data[currentbyte++] = colorbuffer.bgra[t];
-				currentpixel++;
-				if (currentpixel > pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
-				}
-			}
+		const std::uint8_t chunkheader = *in++;
+		const size_t npixels = (chunkheader & 0x7f) + 1;
+		if (npixels * bytespp > static_cast<size_t>(out_end - out)) {
+			std::cerr << "Too many pixels read\n";
+			return false;
 		}
-		else {
-			chunkheader -= 127;
-			in.read(reinterpret_cast<char*>(colorbuffer.bgra), bytespp);
-			if (!in.good()) {
-				std::cerr << "an error occured while reading the header\n";
-				return false;
-			}
-			for (int i = 0; i < chunkheader; i++) {
-				for (int t = 0; t < bytespp; t++)
-					data[currentbyte++] = colorbuffer.bgra[t];
-				currentpixel++;
-				if (currentpixel > pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
-				}
-			}
+		const size_t nbytes = chunkheader < 128 ? npixels * bytespp : bytespp;
+		if (static_cast<size_t>(end - in) < nbytes) {
+			std::cerr << "an error occured while reading the data\n";
+			return false;
 		}
-	} while (currentpixel < pixelcount);
+		if (chunkheader < 128)
+			memcpy(out, in, nbytes);
+		else
+			expand_run(out, in, npixels, bytespp);
+		in += nbytes;
+		out += npixels * bytespp;
+	}
 	return true;
 }
 
 bool TGAImage::write_tga_file(const std::string filename, const bool vflip, const bool rle) const {
+	// mapped pixels may belong to the very file we are about to truncate, and few readers know about
+	// right-to-left rows: both get a linear copy first
+	if (mapping || step < 0) {
+		TGAImage tmp(*this);
+		tmp.make_linear();
+		return tmp.write_tga_file(filename, vflip, rle);
+	}
 	std::uint8_t developer_area_ref[4] = { 0, 0, 0, 0 };
 	std::uint8_t extension_area_ref[4] = { 0, 0, 0, 0 };
 	std::uint8_t footer[18] = { 'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0' };
@@ -126,7 +207,8 @@ bool TGAImage::write_tga_file(const std::string filename, const bool vflip, cons
 	header.width = width;
 	header.height = height;
 	header.datatypecode = (bytespp == GRAYSCALE ? (rle ? 11 : 3) : (rle ? 10 : 2));
-	header.imagedescriptor = vflip ? 0x00 : 0x20; // top-left or bottom-left origin
+	// rows are written in storage order, a vertically flipped image just says so in its header
+	header.imagedescriptor = vflip != (stride < 0) ? 0x00 : 0x20; // bottom-left or top-left origin
 	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
 	if (!out.good()) {
 		out.close();
@@ -134,7 +216,7 @@ bool TGAImage::write_tga_file(const std::string filename, const bool vflip, cons
 		return false;
 	}
 	if (!rle) {
-		out.write(reinterpret_cast<const char*>(data.data()), width * height * bytespp);
+		out.write(reinterpret_cast<const char*>(storage()), width * height * bytespp);
 		if (!out.good()) {
 			std::cerr << "can't unload raw data\n";
 			out.close();
@@ -170,38 +252,122 @@ bool TGAImage::write_tga_file(const std::string filename, const bool vflip, cons
 	return true;
 }
 
-// TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream& out) const {
-	const std::uint8_t max_chunk_length = 128;
-	size_t npixels = width * height;
-	size_t curpix = 0;
-	while (curpix < npixels) {
-		size_t chunkstart = curpix * bytespp;
-		size_t curbyte = curpix * bytespp;
-		std::uint8_t run_length = 1;
-		bool raw = true;
-		while (curpix + run_length < npixels && run_length < max_chunk_length) {
-			bool succ_eq = true;
-			for (int t = 0; succ_eq && t < bytespp; t++)
-				succ_eq = (data[curbyte + t] == data[curbyte + t + bytespp]);
-			curbyte += bytespp;
-			if (1 == run_length)
-				raw = !succ_eq;
-			if (raw && succ_eq) {
-				run_length--;
-				break;
+static int lowest_bit(const unsigned mask) {
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return static_cast<int>(idx);
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// number of leading pixels of p[0..n) equal to the first one
+static size_t run_length(const std::uint8_t* p, const size_t n, const int bytespp) {
+	if (n < 2) return n;
+	const size_t nbytes = (n - 1) * bytespp; // pixel i equals pixel i+1 iff p[k] == p[k + bytespp] for all its bytes
+	size_t i = 0;
+#ifdef TGAIMAGE_SSE2
+	for (; i + 16 <= nbytes; i += 16) {
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + bytespp));
+		const unsigned diff = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) ^ 0xFFFF;
+		if (diff) return 1 + (i + lowest_bit(diff)) / bytespp;
+	}
+#endif
+	while (i < nbytes && p[i] == p[i + bytespp]) i++;
+	return 1 + i / bytespp;
+}
+
+// first pixel in [first, last) starting a run of at least min_run equal pixels among the n pixels of data,
+// last when there is none
+static size_t find_run(const std::uint8_t* data, size_t first, const size_t last, const size_t n, const int bytespp, const size_t min_run) {
+#ifdef TGAIMAGE_SSE2
+	if (1 == bytespp) { // 16 candidates per step
+		for (; first < last && first + 15 + min_run <= n; first += 16) {
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + first));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + first + 1));
+			unsigned eq = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+			if (min_run > 2) {
+				const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + first + 2));
+				eq &= _mm_movemask_epi8(_mm_cmpeq_epi8(b, c));
 			}
-			if (!raw && !succ_eq)
-				break;
-			run_length++;
+			if (eq) return std::min(first + lowest_bit(eq), last);
 		}
-		curpix += run_length;
-		out.put(raw ? run_length - 1 : run_length + 127);
-		if (!out.good()) {
-			std::cerr << "can't dump the tga file\n";
-			return false;
+	}
+	else if (4 == bytespp && 2 == min_run) { // 4 candidates per step
+		for (; first < last && first + 5 <= n; first += 4) {
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + first * 4));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + first * 4 + 4));
+			const unsigned eq = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b)));
+			if (eq) return std::min(first + lowest_bit(eq), last);
+		}
+	}
+	else if (3 == bytespp && 2 == min_run) { // 5 candidates per step, pixel k owns bits 3k..3k+2 of the byte mask
+		for (; first < last && first + 7 <= n; first += 5) {
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + first * 3));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + first * 3 + 3));
+			unsigned eq = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+			eq &= (eq >> 1) & (eq >> 2) & 0x1249;
+			if (eq) return std::min(first + lowest_bit(eq) / 3, last);
+		}
+	}
+#endif
+	for (; first < last && first + min_run <= n; first++)
+		if (run_length(data + first * bytespp, min_run, bytespp) >= min_run) return first;
+	return last;
+}
+
+// Greedy packetizer over pixels [begin, end). A run of two or more becomes an RLE packet, everything in between
+// goes to raw packets. For 8bpp a run of exactly two costs a byte more as its own packet when it splits a raw one,
+// so it stays in the raw packet when that packet goes on with a raw pixel after it; anywhere else, at the start
+// of a packet, before another run or at the end of the range, it is as cheap or cheaper as an RLE packet.
+static void encode_rle(const std::uint8_t* data, size_t begin, const size_t end, const int bytespp, std::vector<std::uint8_t>& out) {
+	const size_t max_chunk_length = 128;
+	out.reserve((end - begin) * bytespp + (end - begin) / max_chunk_length + 1);
+	while (begin < end) {
+		const std::uint8_t* p = data + begin * bytespp;
+		size_t run = run_length(p, std::min(end - begin, max_chunk_length), bytespp);
+		if (run >= 2) {
+			out.push_back(static_cast<std::uint8_t>(run + 127));
+			out.insert(out.end(), p, p + bytespp);
+			begin += run;
+			continue;
 		}
-		out.write(reinterpret_cast<const char*>(data.data() + chunkstart), (raw ? run_length * bytespp : bytespp));
+		const size_t limit = std::min(end, begin + max_chunk_length);
+		size_t stop = find_run(data, begin + 1, limit, end, bytespp, 2);
+		while (1 == bytespp && stop + 2 < limit && run_length(data + stop, 3, 1) == 2 && run_length(data + stop + 2, std::min<size_t>(2, end - stop - 2), 1) == 1)
+			stop = find_run(data, stop + 2, limit, end, bytespp, 2);
+		run = stop - begin;
+		out.push_back(static_cast<std::uint8_t>(run - 1));
+		out.insert(out.end(), p, p + run * bytespp);
+		begin += run;
+	}
+}
+
+// Pixels are split into ranges that start where a run starts, of three or more for 8bpp. The greedy packetizer
+// always starts a packet there, and a run of two is only kept raw when a raw pixel follows it, which never
+// happens right before a range; so the file is the same whatever the number of ranges is.
+bool TGAImage::unload_rle_data(std::ofstream& out) const {
+	const std::uint8_t* pixels = storage();
+	const size_t npixels = width * height;
+	const size_t min_run = 1 == bytespp ? 3 : 2;
+	const size_t nranges = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), npixels / (1 << 16) + 1);
+	std::vector<size_t> bounds(1, 0);
+	for (size_t i = 1; i < nranges; i++) {
+		size_t s = std::max(bounds.back(), i * npixels / nranges);
+		if (s && run_length(pixels + (s - 1) * bytespp, 2, bytespp) == 2) // s is inside a run, skip it
+			s += run_length(pixels + s * bytespp, npixels - s, bytespp);
+		s = find_run(pixels, s, npixels, npixels, bytespp, min_run);
+		if (s > bounds.back() && s < npixels) bounds.push_back(s);
+	}
+	bounds.push_back(npixels);
+
+	std::vector<std::vector<std::uint8_t>> chunks(bounds.size() - 1);
+	ThreadPool::shared().parallel_for(chunks.size(), [&](const size_t i) { encode_rle(pixels, bounds[i], bounds[i + 1], bytespp, chunks[i]); });
+
+	for (const std::vector<std::uint8_t>& chunk : chunks) {
+		out.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
 		if (!out.good()) {
 			std::cerr << "can't dump the tga file\n";
 			return false;
@@ -210,15 +376,50 @@ bool TGAImage::unload_rle_data(std::ofstream& out) const {
 	return true;
 }
 
+const std::uint8_t* TGAImage::pixels() const {
+	return mapping ? mapping->data() : external ? external : data.data();
+}
+
+const std::uint8_t* TGAImage::pixel(const int x, const int y) const {
+	return pixels() + static_cast<std::ptrdiff_t>(origin) + y * stride + x * step;
+}
+
+// first byte of the pixel block, whatever the orientation is
+const std::uint8_t* TGAImage::storage() const {
+	return pixel(step < 0 ? width - 1 : 0, stride < 0 ? height - 1 : 0);
+}
+
+// moves the pixels into data, or back into external, rows top to bottom and pixels left to right
+void TGAImage::make_linear() {
+	size_t bytes_per_line = width * bytespp;
+	if (!mapping && !origin && stride == static_cast<std::ptrdiff_t>(bytes_per_line) && step == bytespp) return;
+	huge_vector<std::uint8_t> tdata(bytes_per_line * height);
+	for (int j = 0; j < height; j++) {
+		if (step > 0) {
+			memcpy(tdata.data() + j * bytes_per_line, pixel(0, j), bytes_per_line);
+			continue;
+		}
+		for (int i = 0; i < width; i++)
+			memcpy(tdata.data() + j * bytes_per_line + i * bytespp, pixel(i, j), bytespp);
+	}
+	if (external) memcpy(external, tdata.data(), tdata.size());
+	else data = std::move(tdata);
+	mapping.reset();
+	origin = 0;
+	stride = bytes_per_line;
+	step = bytespp;
+}
+
 TGAColor TGAImage::get(const int x, const int y) const {
-	if (!data.size() || x < 0 || y < 0 || x >= width || y >= height)
+	if (!pixels() || x < 0 || y < 0 || x >= width || y >= height)
 		return {};
-	return TGAColor(data.data() + (x + y * width) * bytespp, bytespp);
+	return TGAColor(pixel(x, y), bytespp);
 }
 
 void TGAImage::set(int x, int y, const TGAColor & c) {
-	if (!data.size() || x < 0 || y < 0 || x >= width || y >= height) return;
-	memcpy(data.data() + (x + y * width) * bytespp, c.bgra, bytespp);
+	if (mapping) make_linear();
+	if ((!external && !data.size()) || x < 0 || y < 0 || x >= width || y >= height) return;
+	memcpy((external ? external : data.data()) + static_cast<std::ptrdiff_t>(origin) + y * stride + x * step, c.bgra, bytespp);
 }
 
 int TGAImage::get_bytespp() {
@@ -234,43 +435,35 @@ int TGAImage::get_height() const {
 }
 
 void TGAImage::flip_horizontally() {
-	if (!data.size()) return;
-	int half = width >> 1;
-	for (int i = 0; i < half; i++) {
-		for (int j = 0; j < height; j++) {
-			TGAColor c1 = get(i, j);
-			TGAColor c2 = get(width - 1 - i, j);
-			set(i, j, c2);
-			set(width - 1 - i, j, c1);
-		}
-	}
+	origin += (width - 1) * step;
+	step = -step;
 }
 
 void TGAImage::flip_vertically() {
-	if (!data.size()) return;
-	size_t bytes_per_line = width * bytespp;
-	std::vector<std::uint8_t> line(bytes_per_line, 0);
-	int half = height >> 1;
-	for (int j = 0; j < half; j++) {
-		size_t l1 = j * bytes_per_line;
-		size_t l2 = (height - 1 - j) * bytes_per_line;
-		std::copy(data.begin() + l1, data.begin() + l1 + bytes_per_line, line.begin());
-		std::copy(data.begin() + l2, data.begin() + l2 + bytes_per_line, data.begin() + l1);
-		std::copy(line.begin(), line.end(), data.begin() + l2);
-	}
+	origin += (height - 1) * stride;
+	stride = -stride;
 }
 
 std::uint8_t * TGAImage::buffer() {
-	return data.data();
+	make_linear();
+	return external ? external : data.data();
 }
 
 void TGAImage::clear() {
-	data = std::vector<std::uint8_t>(width * height * bytespp, 0);
+	const size_t nbytes = static_cast<size_t>(width) * height * bytespp;
+	if (external) memset(external, 0, nbytes);
+	else data.assign(nbytes, 0); // reuses the allocation when it is large enough
+	mapping.reset();
+	origin = 0;
+	stride = width * bytespp;
+	step = bytespp;
 }
 
 void TGAImage::scale(int w, int h) {
-	if (w <= 0 || h <= 0 || !data.size()) return;
-	std::vector<std::uint8_t> tdata(w * h * bytespp, 0);
+	make_linear();
+	if (w <= 0 || h <= 0 || (!external && !data.size())) return;
+	const std::uint8_t* odata = external ? external : data.data();
+	huge_vector<std::uint8_t> tdata(w * h * bytespp, 0);
 	int nscanline = 0;
 	int oscanline = 0;
 	int erry = 0;
@@ -286,7 +479,7 @@ void TGAImage::scale(int w, int h) {
 			while (errx >= (int)width) {
 				errx -= width;
 				nx += bytespp;
-				memcpy(tdata.data() + nscanline + nx, data.data() + oscanline + ox, bytespp);
+				memcpy(tdata.data() + nscanline + nx, odata + oscanline + ox, bytespp);
 			}
 		}
 		erry += h;
@@ -299,7 +492,9 @@ void TGAImage::scale(int w, int h) {
 		}
 	}
 	data = tdata;
+	external = nullptr; // the scaled image doesn't fit in the caller's block
 	width = w;
 	height = h;
+	stride = w * bytespp;
 }
 
@@ -2,9 +2,13 @@
 #define __IMAGE_H__
 
 #include <cstdint>
+#include <cstddef>
 #include <fstream>
 #include <vector>
+#include <memory>
 #include <algorithm>
+#include "mapped_file.h"
+#include "huge_pages.h"
 
 #pragma pack(push,1)
 struct TGA_Header {
@@ -48,19 +52,36 @@ struct TGAColor {
 
 class TGAImage {
 protected:
-	std::vector<std::uint8_t> data;
+	huge_vector<std::uint8_t> data;
+	std::uint8_t* external; // pixels kept by the caller, used instead of data when set
 	int width;
 	int height;
 	int bytespp;
+	// The pixels are one block of height rows of width*bytespp bytes, in data, in external or in a mapped file.
+	// origin, stride and step place image coordinates on that block, so flipping only changes them.
+	std::shared_ptr<const MappedFile> mapping; // set when the pixels are read in place from a mapped file
+	std::size_t origin;                        // byte offset of pixel (0,0) from the start of the pixel storage
+	std::ptrdiff_t stride;                     // signed byte distance between two consecutive rows
+	std::ptrdiff_t step;                       // signed byte distance between two consecutive pixels of a row
 
-	bool   load_rle_data(std::ifstream& in);
+	bool   load_rle_data(const std::uint8_t* in, const std::uint8_t* end);
 	bool unload_rle_data(std::ofstream& out) const;
+	const std::uint8_t* pixels() const;
+	const std::uint8_t* pixel(const int x, const int y) const;
+	const std::uint8_t* storage() const;
+	void make_linear();
 public:
 	enum Format { GRAYSCALE = 1, RGB = 3, RGBA = 4 };
 
 	TGAImage();
 	TGAImage(const int w, const int h, const int bpp);
+	TGAImage(const int w, const int h, const int bpp, std::uint8_t* storage); // black, in w*h*bpp bytes that outlive the image
+	TGAImage(const TGAImage& img); // copies own their pixels, wherever the original keeps them
+	TGAImage(TGAImage&& img) = default;
+	TGAImage& operator=(const TGAImage& img);
+	TGAImage& operator=(TGAImage&& img) = default;
 	bool  read_tga_file(const std::string filename);
+	bool   map_tga_file(const std::string filename);
 	bool write_tga_file(const std::string filename, const bool vflip = true, const bool rle = true) const;
 	void flip_horizontally();
 	void flip_vertically();
@@ -71,7 +92,7 @@ public:
 	int get_height() const;
 	int get_bytespp();
 	std::uint8_t* buffer();
-	void clear();
+	void clear(); // black, in place
 };
 
 #endif //__IMAGE_H__
@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include "thread_pool.h"
+
+// which pool and deque the calling thread works for, if any
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local std::size_t current_queue = 0;
+
+ThreadPool::ThreadPool(const unsigned nworkers) : queues(), workers(), queued(0), stolen(0), mutex(), wake(), stopping(false) {
+	for (unsigned i = 0; i <= std::max(1u, nworkers); i++)
+		queues.push_back(std::make_unique<Queue>());
+	for (std::size_t i = 0; i + 1 < queues.size(); i++)
+		workers.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& w : workers) w.join();
+}
+
+void ThreadPool::push(std::function<void()> job) {
+	Queue& q = *queues[current_pool == this ? current_queue : queues.size() - 1];
+	queued++;
+	{
+		std::lock_guard<std::mutex> lock(q.mutex);
+		q.jobs.push_back(std::move(job));
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex); // a worker between checking queued and sleeping holds it
+	}
+	wake.notify_one();
+}
+
+// own deque from the back, then the shared queue, then the other workers' deques from the front
+bool ThreadPool::pop(const std::size_t self, std::function<void()>& job) {
+	const std::size_t nworkers = queues.size() - 1;
+	if (self < nworkers) {
+		Queue& q = *queues[self];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.jobs.empty()) {
+			job = std::move(q.jobs.back());
+			q.jobs.pop_back();
+			queued--;
+			return true;
+		}
+	}
+	for (std::size_t i = 0; i < nworkers + 1; i++) {
+		const std::size_t victim = (nworkers + self + i) % (nworkers + 1); // the shared queue comes first
+		if (victim == self && self < nworkers) continue; // a thread from outside the pool takes from the shared queue
+		Queue& q = *queues[victim];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (q.jobs.empty()) continue;
+		job = std::move(q.jobs.front());
+		q.jobs.pop_front();
+		queued--;
+		if (victim != nworkers) stolen++;
+		return true;
+	}
+	return false;
+}
+
+bool ThreadPool::run_one() {
+	std::function<void()> job;
+	if (!pop(current_pool == this ? current_queue : queues.size() - 1, job)) return false;
+	job();
+	return true;
+}
+
+void ThreadPool::work(const std::size_t index) {
+	current_pool = this;
+	current_queue = index;
+	for (std::function<void()> job;;) {
+		if (pop(index, job)) {
+			job();
+			job = nullptr;
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mutex);
+		wake.wait(lock, [this] { return stopping || queued > 0; });
+		if (stopping && !queued) return;
+	}
+}
+
+// Every participant claims indices from a shared counter until there are none left, the caller included.
+// An index is only ever in flight on a thread that is running, so waiting for the count of finished ones
+// can't hang on a helper that is still queued; a helper that starts late finds nothing to claim.
+void ThreadPool::parallel_for(const std::size_t n, const std::function<void(std::size_t)>& body) {
+	if (!n) return;
+	struct Range {
+		const std::function<void(std::size_t)>* body;
+		std::size_t n;
+		std::atomic<std::size_t> next;
+		std::atomic<std::size_t> done;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	std::shared_ptr<Range> range = std::make_shared<Range>();
+	range->body = &body;
+	range->n = n;
+	range->next = 0;
+	range->done = 0;
+	auto run = [range]() {
+		for (std::size_t i; (i = range->next++) < range->n;) {
+			(*range->body)(i);
+			if (++range->done == range->n) {
+				std::lock_guard<std::mutex> lock(range->mutex);
+				range->finished.notify_all();
+			}
+		}
+	};
+	for (std::size_t i = std::min<std::size_t>(n - 1, workers.size()); i--;)
+		push(run);
+	run();
+	// the last indices may be running elsewhere, and a body waiting for queued work may be among them
+	while (range->done != range->n)
+		if (!run_one()) {
+			std::unique_lock<std::mutex> lock(range->mutex);
+			range->finished.wait(lock, [&range] { return range->done == range->n; });
+		}
+}
+
+unsigned ThreadPool::size() const {
+	return static_cast<unsigned>(workers.size());
+}
+
+std::size_t ThreadPool::queue_depth() const {
+	return queued;
+}
+
+std::uint64_t ThreadPool::steals() const {
+	return stolen;
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool([]() {
+		const char* env = std::getenv("TINYRENDERER_THREADS");
+		const int n = env ? std::atoi(env) : 0;
+		return n > 0 ? static_cast<unsigned>(n) : std::thread::hardware_concurrency();
+	}());
+	return pool;
+}
+
+TaskGraph::TaskGraph(ThreadPool& pool) : pool(pool), tasks(), remaining(0), mutex(), finished() {
+}
+
+std::size_t TaskGraph::add(std::function<void()> job, std::initializer_list<std::size_t> dependencies) {
+	return add(std::move(job), std::vector<std::size_t>(dependencies));
+}
+
+std::size_t TaskGraph::add(std::function<void()> job, const std::vector<std::size_t>& dependencies) {
+	const std::size_t id = tasks.size();
+	tasks.emplace_back();
+	tasks.back().job = std::move(job);
+	tasks.back().waiting = dependencies.size();
+	for (const std::size_t d : dependencies) {
+		assert(d < id);
+		tasks[d].dependents.push_back(id);
+	}
+	return id;
+}
+
+// The last job to finish decrements remaining under the lock, so once run() has seen it reach zero under the
+// same lock nothing touches the graph any more and it may be destroyed. Queuing a job wakes run() as well: it
+// may be waiting inside a job on a pool with no other worker free to take it.
+void TaskGraph::start(const std::size_t id) {
+	pool.push([this, id]() {
+		Task& task = tasks[id];
+		task.job();
+		for (const std::size_t d : task.dependents)
+			if (!--tasks[d].waiting) start(d);
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!--remaining) finished.notify_all();
+	});
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+	}
+	finished.notify_all();
+}
+
+void TaskGraph::run() {
+	std::vector<std::size_t> roots; // gathered first, started jobs may bring others' counts down to zero
+	for (std::size_t i = 0; i < tasks.size(); i++)
+		if (!tasks[i].waiting) roots.push_back(i);
+	std::unique_lock<std::mutex> lock(mutex);
+	remaining = tasks.size();
+	lock.unlock();
+	for (const std::size_t r : roots) start(r);
+	lock.lock();
+	while (remaining) {
+		lock.unlock();
+		const bool ran = pool.run_one();
+		lock.lock();
+		if (!ran) finished.wait(lock, [this] { return !remaining || pool.queue_depth() > 0; });
+	}
+}
+
+std::size_t TaskGraph::size() const {
+	return tasks.size();
+}
@@ -0,0 +1,100 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads, each with its own deque of jobs. A worker pushes and pops at the back of its own
+// deque, so jobs spawned by a job run depth first and stay in cache; a worker that runs dry steals from the front
+// of the others'. Jobs submitted from outside the pool go to a shared queue that everybody takes from.
+// submit() hands back a future for the result of a job, parallel_for() spreads an index range over the workers
+// and the calling thread. Threads that have to wait run queued jobs meanwhile, so both parallel_for() and wait()
+// may be called from inside a job.
+class ThreadPool {
+public:
+	explicit ThreadPool(const unsigned nworkers);
+	~ThreadPool(); // runs what is still queued, then joins
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	template<class F> std::future<typename std::invoke_result<F>::type> submit(F f) {
+		auto task = std::make_shared<std::packaged_task<typename std::invoke_result<F>::type()>>(std::move(f));
+		auto res = task->get_future();
+		push([task]() { (*task)(); });
+		return res;
+	}
+	template<class Future> void wait(const Future& f) {
+		while (f.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			if (!run_one()) { // nothing queued, the job is running on another thread
+				f.wait();
+				return;
+			}
+	}
+	void parallel_for(const std::size_t n, const std::function<void(std::size_t)>& body);
+	unsigned size() const;
+	std::size_t queue_depth() const; // jobs waiting in all the queues
+	std::uint64_t steals() const;    // jobs taken from another worker's deque since the start
+	// one worker per hardware thread, or as many as the TINYRENDERER_THREADS environment variable says,
+	// started on first use
+	static ThreadPool& shared();
+private:
+	friend class TaskGraph;
+	struct Queue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> jobs;
+	};
+	std::vector<std::unique_ptr<Queue>> queues; // one per worker, the shared one last
+	std::vector<std::thread> workers;
+	std::atomic<std::size_t> queued; // never below the number of jobs in the queues
+	std::atomic<std::uint64_t> stolen;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+
+	void push(std::function<void()> job);
+	bool pop(const std::size_t self, std::function<void()>& job);
+	bool run_one();
+	void work(const std::size_t index);
+};
+
+// Jobs with dependencies, run on a pool. add() returns an id to name as a dependency of jobs added later, so the
+// graph is acyclic by construction. run() queues every job as soon as all of its dependencies are done and returns
+// when the last one has finished, running jobs itself meanwhile. A graph is run once and not changed while running.
+class TaskGraph {
+public:
+	explicit TaskGraph(ThreadPool& pool = ThreadPool::shared());
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+
+	std::size_t add(std::function<void()> job, std::initializer_list<std::size_t> dependencies = {});
+	std::size_t add(std::function<void()> job, const std::vector<std::size_t>& dependencies);
+	void run();
+	std::size_t size() const;
+private:
+	struct Task {
+		std::function<void()> job;
+		std::vector<std::size_t> dependents;
+		std::atomic<std::size_t> waiting; // dependencies not done yet
+	};
+	ThreadPool& pool;
+	std::deque<Task> tasks; // a deque never moves its elements
+	std::size_t remaining;  // guarded by mutex
+	std::mutex mutex;
+	std::condition_variable finished;
+
+	void start(const std::size_t id);
+};
+
+#endif //__THREAD_POOL_H__
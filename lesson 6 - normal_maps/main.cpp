@@ -5,6 +5,7 @@
 #include "model.h"
 #include "geometry.h"
 #include "../common/tgaimage.h"
+#include "../common/fastmath.h"
 #include "ourGL.h"
 
 
@@ -165,7 +166,7 @@ struct PhongShader : public IShader
 		vec3f r = (n * (intensity * 2.0f) - l).normalize();
 		
 		//
-		float spec = pow(std::max(r.z, 0.0f), model_->specular(uv));
+		float spec = fast_pow(std::max(r.z, 0.0f), model_->specular(uv));
 
 		float diff = intensity;
 		TGAColor c = model_->diffuse(uv);
@@ -218,7 +219,7 @@ struct PhongShader2 : public IShader
 		vec3f r = (bn * (intensity * 2.0f) - l).normalize();
 
 		//
-		float spec = pow(std::max(r.z, 0.0f), model_->specular(uv));
+		float spec = fast_pow(std::max(r.z, 0.0f), model_->specular(uv));
 
 		float diff = intensity;
 		TGAColor c = model_->diffuse(uv);
@@ -343,7 +344,7 @@ struct PhongShader3 : public IShader
 		vec3f r = (n * (diff * 2.0f) - light_dir).normalize();
 
 		//
-		float spec = pow(std::max(r.z, 0.0f), model_->specular(uv));
+		float spec = fast_pow(std::max(r.z, 0.0f), model_->specular(uv));
 
 		TGAColor c = model_->diffuse(uv);
 		for (int i = 0; i < 3; i++)
@@ -6,6 +6,11 @@
 #include <cassert>
 #include <iostream>
 
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define GEOMETRY_SSE
+#endif
+
 
 template <size_t DimCols, size_t DimRows, typename T> class mat;
 
@@ -133,6 +138,130 @@ template<typename T> struct dt<1, T>
 };
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+template<size_t DIM, typename T> struct inv
+{
+	static mat<DIM, DIM, T> invert_transpose(const mat<DIM, DIM, T>& src)
+	{
+		mat<DIM, DIM, T> ret = src.adjugate();
+		return ret / (ret[0] * src[0]);
+	}
+
+	static mat<DIM, DIM, T> invert(const mat<DIM, DIM, T>& src)
+	{
+		return invert_transpose(src).transpose();
+	}
+
+	static mat<DIM, DIM, T> invert_affine(const mat<DIM, DIM, T>& src)
+	{
+		mat<DIM - 1, DIM - 1, T> linear = src.get_minor(DIM - 1, DIM - 1).invert();
+		vec<DIM - 1, T> translation = proj<DIM - 1>(src.col(DIM - 1));
+		mat<DIM, DIM, T> ret = mat<DIM, DIM, T>::identity();
+		for (size_t i = DIM - 1; i--;)
+		{
+			for (size_t j = DIM - 1; j--; ret[i][j] = linear[i][j]);
+			ret[i][DIM - 1] = -(linear[i] * translation);
+		}
+		return ret;
+	}
+};
+
+//the rows of the cofactor matrix of a 3x3 are cross products of its rows
+template<typename T> struct inv<3, T>
+{
+	static mat<3, 3, T> invert_transpose(const mat<3, 3, T>& src)
+	{
+		mat<3, 3, T> ret;
+		ret[0] = cross(src[1], src[2]);
+		ret[1] = cross(src[2], src[0]);
+		ret[2] = cross(src[0], src[1]);
+		const T inv_det = T(1) / (ret[0] * src[0]);
+		for (size_t i = 3; i--; ret[i] = ret[i] * inv_det);
+		return ret;
+	}
+
+	static mat<3, 3, T> invert(const mat<3, 3, T>& src)
+	{
+		return invert_transpose(src).transpose();
+	}
+
+	static mat<3, 3, T> invert_affine(const mat<3, 3, T>& src)
+	{
+		const T inv_det = T(1) / (src[0][0] * src[1][1] - src[0][1] * src[1][0]);
+		mat<3, 3, T> ret = mat<3, 3, T>::identity();
+		ret[0][0] = src[1][1] * inv_det;
+		ret[0][1] = -src[0][1] * inv_det;
+		ret[1][0] = -src[1][0] * inv_det;
+		ret[1][1] = src[0][0] * inv_det;
+		ret[0][2] = -(ret[0][0] * src[0][2] + ret[0][1] * src[1][2]);
+		ret[1][2] = -(ret[1][0] * src[0][2] + ret[1][1] * src[1][2]);
+		return ret;
+	}
+};
+
+//every 3x3 minor of a 4x4 expands into 2x2 determinants of its top two rows (s) and its bottom two (c)
+template<typename T> struct inv<4, T>
+{
+	static mat<4, 4, T> invert_transpose(const mat<4, 4, T>& m)
+	{
+		const T s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+		const T s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+		const T s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+		const T s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+		const T s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+		const T s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+		const T c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+		const T c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+		const T c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+		const T c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+		const T c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+		const T c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+
+		mat<4, 4, T> ret;
+		ret[0][0] = m[1][1] * c5 - m[1][2] * c4 + m[1][3] * c3;
+		ret[1][0] = -m[0][1] * c5 + m[0][2] * c4 - m[0][3] * c3;
+		ret[2][0] = m[3][1] * s5 - m[3][2] * s4 + m[3][3] * s3;
+		ret[3][0] = -m[2][1] * s5 + m[2][2] * s4 - m[2][3] * s3;
+		ret[0][1] = -m[1][0] * c5 + m[1][2] * c2 - m[1][3] * c1;
+		ret[1][1] = m[0][0] * c5 - m[0][2] * c2 + m[0][3] * c1;
+		ret[2][1] = -m[3][0] * s5 + m[3][2] * s2 - m[3][3] * s1;
+		ret[3][1] = m[2][0] * s5 - m[2][2] * s2 + m[2][3] * s1;
+		ret[0][2] = m[1][0] * c4 - m[1][1] * c2 + m[1][3] * c0;
+		ret[1][2] = -m[0][0] * c4 + m[0][1] * c2 - m[0][3] * c0;
+		ret[2][2] = m[3][0] * s4 - m[3][1] * s2 + m[3][3] * s0;
+		ret[3][2] = -m[2][0] * s4 + m[2][1] * s2 - m[2][3] * s0;
+		ret[0][3] = -m[1][0] * c3 + m[1][1] * c1 - m[1][2] * c0;
+		ret[1][3] = m[0][0] * c3 - m[0][1] * c1 + m[0][2] * c0;
+		ret[2][3] = -m[3][0] * s3 + m[3][1] * s1 - m[3][2] * s0;
+		ret[3][3] = m[2][0] * s3 - m[2][1] * s1 + m[2][2] * s0;
+		const T inv_det = T(1) / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+		for (size_t i = 4; i--; ret[i] = ret[i] * inv_det);
+		return ret;
+	}
+
+	static mat<4, 4, T> invert(const mat<4, 4, T>& m)
+	{
+		return invert_transpose(m).transpose();
+	}
+
+	//the columns of the inverse of the linear part are the cross products of its rows over the determinant
+	static mat<4, 4, T> invert_affine(const mat<4, 4, T>& m)
+	{
+		const vec<3, T> r0 = proj<3>(m[0]), r1 = proj<3>(m[1]), r2 = proj<3>(m[2]);
+		const vec<3, T> c[3] = { cross(r1, r2), cross(r2, r0), cross(r0, r1) };
+		const vec<3, T> translation(m[0][3], m[1][3], m[2][3]);
+		const T inv_det = T(1) / (c[0] * r0);
+		mat<4, 4, T> ret = mat<4, 4, T>::identity();
+		for (size_t i = 3; i--;)
+		{
+			const vec<3, T> row = vec<3, T>(c[0][i], c[1][i], c[2][i]) * inv_det;
+			for (size_t j = 3; j--; ret[i][j] = row[j]);
+			ret[i][3] = -(row * translation);
+		}
+		return ret;
+	}
+};
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 template<size_t DimRows, size_t DimCols, typename T> class mat
 {
 	vec<DimCols, T> rows[DimRows];
@@ -203,19 +332,23 @@ public:
 		return ret;
 	}
 
-	mat<DimRows, DimCols, T> invert_transpose()
+	mat<DimRows, DimCols, T> invert_transpose() const
+	{
+		return inv<DimCols, T>::invert_transpose(*this);
+	}
+
+	mat<DimCols, DimRows, T> invert() const
 	{
-		mat<DimRows, DimCols, T> ret = adjugate();
-		T tmp = ret[0] * rows[0];
-		return ret / tmp;
+		return inv<DimCols, T>::invert(*this);
 	}
 
-	mat<DimCols, DimRows, T> invert()
+	//for a last row of 0 ... 0 1, like ModelView: inverts the linear part and applies it to the negated translation
+	mat<DimRows, DimCols, T> invert_affine() const
 	{
-		return invert_transpose().transpose();
+		return inv<DimCols, T>::invert_affine(*this);
 	}
 
-	mat<DimCols, DimRows, T> transpose()
+	mat<DimCols, DimRows, T> transpose() const
 	{
 		mat<DimCols, DimRows, T> ret;
 		for (size_t i = DimRows; i--; ret[i] = this->col(i));
@@ -245,7 +378,7 @@ template<size_t R1, size_t C1, size_t C2, typename T> mat<R1, C2, T>operator*(co
 
 template<size_t DimRows, size_t DimCols, typename T> mat<DimRows, DimCols, T> operator/(mat<DimRows, DimCols, T> lhs, const T& rhs)
 {
-	for (size_t i = DimRows; i--; lhs[i] / rhs);
+	for (size_t i = DimRows; i--; lhs[i] = lhs[i] / rhs);
 	return lhs;
 }
 
@@ -255,6 +388,159 @@ template<size_t DimRows, size_t DimCols, typename T> std::ostream& operator<<(st
 	return out;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SSE versions of what every vertex goes through: vec4f, Matrix and the 4x3 clip coordinates of a triangle. They keep
+// the interface of the generic templates and sum products in the same order, so results don't change. 32-bit MSVC
+// can't pass 16-byte aligned types by value and keeps the generic code, as does everything without SSE.
+
+#ifdef GEOMETRY_SSE
+template<> struct vec<4, float>
+{
+	vec() : data_() {}
+	explicit vec(const __m128 m) { _mm_store_ps(data_, m); }
+	float& operator[](const size_t i) { assert(i < 4); return data_[i]; }
+	const float& operator[](const size_t i) const { assert(i < 4); return data_[i]; }
+	__m128 simd() const { return _mm_load_ps(data_); }
+private:
+	alignas(16) float data_[4];
+};
+
+inline float operator*(const vec<4, float>& lhs, const vec<4, float>& rhs)
+{
+	const __m128 p = _mm_mul_ps(lhs.simd(), rhs.simd());
+	__m128 res = _mm_add_ss(_mm_setzero_ps(), _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3)));
+	res = _mm_add_ss(res, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2)));
+	res = _mm_add_ss(res, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(_mm_add_ss(res, p));
+}
+
+inline vec<4, float> operator+(const vec<4, float>& lhs, const vec<4, float>& rhs)
+{
+	return vec<4, float>(_mm_add_ps(lhs.simd(), rhs.simd()));
+}
+
+inline vec<4, float> operator-(const vec<4, float>& lhs, const vec<4, float>& rhs)
+{
+	return vec<4, float>(_mm_sub_ps(lhs.simd(), rhs.simd()));
+}
+
+inline vec<4, float> operator*(const vec<4, float>& lhs, const float rhs)
+{
+	return vec<4, float>(_mm_mul_ps(lhs.simd(), _mm_set1_ps(rhs)));
+}
+
+inline vec<4, float> operator/(const vec<4, float>& lhs, const float rhs)
+{
+	return vec<4, float>(_mm_div_ps(lhs.simd(), _mm_set1_ps(rhs)));
+}
+
+//one row of a product, lhs[3] * r3 + ... + lhs[0] * r0 in the order of the dot product above
+inline __m128 sse_row_product(const __m128 lhs, const __m128 r0, const __m128 r1, const __m128 r2, const __m128 r3)
+{
+	__m128 res = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(3, 3, 3, 3)), r3));
+	res = _mm_add_ps(res, _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(2, 2, 2, 2)), r2));
+	res = _mm_add_ps(res, _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(1, 1, 1, 1)), r1));
+	return _mm_add_ps(res, _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(0, 0, 0, 0)), r0));
+}
+
+template<> inline mat<4, 4, float> mat<4, 4, float>::transpose() const
+{
+	__m128 r0 = rows[0].simd(), r1 = rows[1].simd(), r2 = rows[2].simd(), r3 = rows[3].simd();
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	mat<4, 4, float> ret;
+	ret[0] = vec<4, float>(r0);
+	ret[1] = vec<4, float>(r1);
+	ret[2] = vec<4, float>(r2);
+	ret[3] = vec<4, float>(r3);
+	return ret;
+}
+
+inline vec<4, float> operator*(const mat<4, 4, float>& lhs, const vec<4, float>& rhs)
+{
+	const __m128 v = rhs.simd();
+	__m128 p0 = _mm_mul_ps(lhs[0].simd(), v), p1 = _mm_mul_ps(lhs[1].simd(), v), p2 = _mm_mul_ps(lhs[2].simd(), v), p3 = _mm_mul_ps(lhs[3].simd(), v);
+	_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+	return vec<4, float>(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_setzero_ps(), p3), p2), p1), p0));
+}
+
+inline mat<4, 4, float> operator*(const mat<4, 4, float>& lhs, const mat<4, 4, float>& rhs)
+{
+	const __m128 r0 = rhs[0].simd(), r1 = rhs[1].simd(), r2 = rhs[2].simd(), r3 = rhs[3].simd();
+	mat<4, 4, float> result;
+	for (size_t i = 4; i--; result[i] = vec<4, float>(sse_row_product(lhs[i].simd(), r0, r1, r2, r3)));
+	return result;
+}
+
+//rows are padded to 16 bytes so that each one loads into a register, the padding stays out of the interface
+template<> class mat<4, 3, float>
+{
+	struct alignas(16) padded_row
+	{
+		vec<3, float> v;
+		float pad;
+	};
+	padded_row rows[4];
+public:
+	mat() : rows() {}
+	vec<3, float>& operator[](const size_t idx)
+	{
+		assert(idx < 4);
+		return rows[idx].v;
+	}
+	const vec<3, float>& operator[](const size_t idx) const
+	{
+		assert(idx < 4);
+		return rows[idx].v;
+	}
+
+	vec<4, float> col(const size_t idx) const
+	{
+		assert(idx < 3);
+		vec<4, float> ret;
+		for (size_t i = 4; i--; ret[i] = rows[i].v[idx]);
+		return ret;
+	}
+
+	void set_col(size_t idx, vec<4, float> v)
+	{
+		assert(idx < 3);
+		for (int i = 4; i--; rows[i].v[idx] = v[i]);
+	}
+
+	static mat<4, 3, float> identity()
+	{
+		mat<4, 3, float> ret;
+		for (size_t i = 4; i--;)
+		{
+			for (size_t j = 3; j--; ret[i][j] = (i == j));
+		}
+		return ret;
+	}
+
+	mat<3, 4, float> transpose() const
+	{
+		__m128 r0 = simd(0), r1 = simd(1), r2 = simd(2), r3 = simd(3);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		mat<3, 4, float> ret;
+		ret[0] = vec<4, float>(r0);
+		ret[1] = vec<4, float>(r1);
+		ret[2] = vec<4, float>(r2);
+		return ret;
+	}
+
+	__m128 simd(const size_t idx) const { return _mm_load_ps(&rows[idx].v.x); }
+	void set_simd(const size_t idx, const __m128 m) { _mm_store_ps(&rows[idx].v.x, m); }
+};
+
+inline mat<4, 3, float> operator*(const mat<4, 4, float>& lhs, const mat<4, 3, float>& rhs)
+{
+	const __m128 r0 = rhs.simd(0), r1 = rhs.simd(1), r2 = rhs.simd(2), r3 = rhs.simd(3);
+	mat<4, 3, float> result;
+	for (size_t i = 4; i--; result.set_simd(i, sse_row_product(lhs[i].simd(), r0, r1, r2, r3)));
+	return result;
+}
+#endif
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 typedef vec<3, float> vec3f;
@@ -3,6 +3,8 @@
 #include <iostream>
 
 #include "../common/tgaimage.h"
+#include "../common/fastmath.h"
+#include "../common/frame_graph.h"
 #include "model.h"
 #include "geometry.h"
 #include "our_gl.h"
@@ -11,7 +13,6 @@
 
 const int width = 800;
 const int height = 800;
-float* shadowbuffer = NULL;
 
 vec3f light_dir(1, 1, 0);
 vec3f eye(1, 1, 3);
@@ -51,8 +52,9 @@ struct Shader : public IShader
 	mat<4, 4, float> uniform_Mshadow;
 	mat<2, 3, float> varying_uv;
 	mat<3, 3, float> varying_tri;
+	const float* shadowbuffer;
 
-	Shader(Matrix& M, Matrix MIT, Matrix MS) : uniform_M(M), uniform_MIT(MIT), uniform_Mshadow(MS), varying_uv(), varying_tri() {}
+	Shader(Matrix& M, Matrix MIT, Matrix MS, const float* shadowbuffer) : uniform_M(M), uniform_MIT(MIT), uniform_Mshadow(MS), varying_uv(), varying_tri(), shadowbuffer(shadowbuffer) {}
 	
 	virtual vec4f vertex(int iface, int nthvert)
 	{
@@ -75,7 +77,7 @@ struct Shader : public IShader
 		vec3f n = proj<3>(uniform_MIT * embed<4>(pmodel->normal(uv))).normalize();
 		vec3f l = proj<3>(uniform_M * embed<4>(light_dir)).normalize();
 		vec3f r = (n * (n * l * 2.f) - l).normalize();
-		float spec = pow(std::max(r.z, 0.0f), pmodel->specular(uv));
+		float spec = fast_pow(std::max(r.z, 0.0f), pmodel->specular(uv));
 		float diff = std::max(0.0f, n * l);
 		
 		TGAColor c = pmodel->diffuse(uv);
@@ -91,25 +93,20 @@ int main()
 {
 	//geometry_test();
 	
-	
-	float* zbuffer = new float[width * height];
-	shadowbuffer = new float[width * height];
-
-	for (int i = width * height; i--;)
-	{
-		zbuffer[i] =  -std::numeric_limits<float>::max();
-		shadowbuffer[i] = -std::numeric_limits<float>::max();
-	}
-
 	pmodel = new Model("../resources/diablo3_pose/diablo3_pose.obj");
 	assert(pmodel);
 
 	light_dir.normalize();
-	
-	
-	//rendering shadow buffer
+
+	FrameGraph graph;
+	const FrameGraph::Resource shadowbuffer = graph.create_buffer("shadow buffer", width, height);
+	const FrameGraph::Resource shadowcolor = graph.create_image("shadow color", width, height, TGAImage::RGB);
+	const FrameGraph::Resource zbuffer = graph.create_buffer("z buffer", width, height);
+	const FrameGraph::Resource frame = graph.create_image("frame", width, height, TGAImage::RGB);
+	Matrix M;
+
+	graph.add_pass("shadow", {}, { shadowbuffer, shadowcolor }, [&]()
 	{
-		TGAImage depth(width, height, TGAImage::RGB);
 		lookat(light_dir, center, up);
 		viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
 		projection(0);
@@ -123,23 +120,18 @@ int main()
 				screen_coords[j] = depthshader.vertex(i, j);
 			}
 
-			triangle(screen_coords, depthshader, depth, shadowbuffer);
+			triangle(screen_coords, depthshader, graph.image(shadowcolor), graph.buffer(shadowbuffer));
 		}
+		M = Viewport * Projection * ModelView;
+	});
 
-	//	depth.flip_vertically();
-		depth.write_tga_file("depth.tga");
-	}
-
-	Matrix M = Viewport * Projection * ModelView;
-	
-
-	{//rendering the frame buffer
-		TGAImage frame(width, height, TGAImage::RGB);
+	graph.add_pass("frame", { shadowbuffer, zbuffer }, { zbuffer, frame }, [&]()
+	{
 		lookat(eye, center, up);
 		viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
 		projection(-1.f / (eye - center).norm());
 		
-		Shader shader(ModelView, (Projection * ModelView).invert_transpose(), M * (Viewport * Projection * ModelView).invert());
+		Shader shader(ModelView, (Projection * ModelView).invert_transpose(), M * (Viewport * Projection * ModelView).invert(), graph.buffer(shadowbuffer));
 		vec4f screen_coords[3];
 
 		for (int i = 0; i < pmodel->nfaces(); i++)
@@ -149,14 +141,15 @@ int main()
 				screen_coords[j] = shader.vertex(i, j);
 			}
 
-			triangle(screen_coords, shader, frame, zbuffer);
+			triangle(screen_coords, shader, graph.image(frame), graph.buffer(zbuffer));
 		}
+	});
 
-		frame.write_tga_file("framebuffer2.tga");
-	}
+	graph.output(frame, "framebuffer2.tga");
+	graph.output(shadowcolor, "depth.tga");
+	graph.execute();
+	std::cerr << "# frame graph: " << graph.memory() / 1024 << " KiB of buffers, " << graph.unaliased_memory() / 1024 << " KiB without aliasing" << std::endl;
 
-	delete []zbuffer;
-	delete []shadowbuffer;
 	delete pmodel;
 	return 0;
-}
\ No newline at end of file
+}
@@ -2,14 +2,16 @@
 #include <cstdlib>
 #include <limits>
 #include <iostream>
+#include <algorithm>
 #include "../common/tgaimage.h"
+#include "../common/thread_pool.h"
+#include "../common/frame_arena.h"
 #include "model.h"
 #include "geometry.h"
 #include "our_gl.h"
 
 #define M_PI       3.14159265358979323846   // pi
 Model* model = NULL;
-float* shadowbuffer = NULL;
 const int width = 800;
 const int height = 800;
 
@@ -19,18 +21,20 @@ vec3f center(0, 0, 0);
 vec3f up(0, 1, 0);
 
 TGAImage total(1024, 1024, TGAImage::GRAYSCALE);
-TGAImage occl(1024, 1024, TGAImage::GRAYSCALE);
 
 
 struct AOShader : public IShader
 {
+	const RenderContext& gl;
 	mat<2, 3, float> varying_uv;
 	mat<4, 3, float> varying_tri;
 	TGAImage aoimage;
 
+	AOShader(const RenderContext& gl) : gl(gl) {}
+
 	virtual vec4f vertex(int iface, int nthvert)
 	{
-		vec4f gl_vertex = Projection * ModelView * embed<4>(model->vert(iface, nthvert));
+		vec4f gl_vertex = gl.Projection * gl.ModelView * embed<4>(model->vert(iface, nthvert));
 		varying_tri.set_col(nthvert, gl_vertex);
 		varying_uv.set_col(nthvert,model->uv(iface, nthvert));
 		return gl_vertex;
@@ -48,11 +52,14 @@ struct AOShader : public IShader
 
 struct ZShader : public IShader
 {
+	const RenderContext& gl;
 	mat<4, 3, float> varying_tri;
+
+	ZShader(const RenderContext& gl) : gl(gl) {}
 	
 	virtual vec4f vertex(int iface, int nthvert)
 	{
-		vec4f gl_vertex = Projection * ModelView * embed<4>(model->vert(iface, nthvert));
+		vec4f gl_vertex = gl.Projection * gl.ModelView * embed<4>(model->vert(iface, nthvert));
 		varying_tri.set_col(nthvert, gl_vertex);
 	//	std::cout << varying_tri.col(nthvert) << std::endl;
 		return gl_vertex;
@@ -65,15 +72,21 @@ struct ZShader : public IShader
 	}
 };
 
+//marks the texels of the surface the light sees, shadowbuffer holds the depth pass of the same view
 struct Shader : public IShader
 {
+	const RenderContext& gl;
+	const float* shadowbuffer;
+	TGAImage& occl;
 	mat<2, 3, float> varying_uv;
 	mat<4, 3, float> varying_tri;
 
+	Shader(const RenderContext& gl, const float* shadowbuffer, TGAImage& occl) : gl(gl), shadowbuffer(shadowbuffer), occl(occl) {}
+
 	virtual vec4f vertex(int iface, int nthvert)
 	{
 		varying_uv.set_col(nthvert, model->uv(iface, nthvert));
-		vec4f gl_vertex = Projection * ModelView * embed<4>(model->vert(iface, nthvert));
+		vec4f gl_vertex = gl.Projection * gl.ModelView * embed<4>(model->vert(iface, nthvert));
 		varying_tri.set_col(nthvert, gl_vertex);
 		return gl_vertex;
 	}
@@ -101,89 +114,102 @@ vec3f rand_point_on_unit_sphere()
 	return vec3f(sin(phi) * cos(theta), sin(phi) * sin(theta), cos(phi));
 }
 
-int main()
+//renders the model from one view, first its depth then the texels that depth shows, with the targets in arena
+void bake_view(vec3f eye, vec3f up, TGAImage& occl, bool write_zbuffer, FrameArena& arena)
 {
-	float* zbuffer = new float[width * height];
-	shadowbuffer = new float[width * height];
-	model = new Model("../resources/diablo3_pose/diablo3_pose.obj");
-
-	//TGAImage frame(width, height, TGAImage::RGB);
+	arena.reset();
+	RenderContext gl(width, height, arena);
+	gl.lookat(eye, center, up);
+	gl.viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
+	gl.projection(0);
 
-	
-	lookat(eye, center, up);
-	viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
-	projection(-1.f / (eye - center).norm());
-	for (int i = width * height; i--; zbuffer[i] = -std::numeric_limits<float>::max());
-
-		const int nrenders = 100;
-		for (int iter = 1; iter <= nrenders; iter++)
+	ZShader zshader(gl);
+	for (int i = 0; i < model->nfaces(); i++)
+	{
+		for (int j = 0; j < 3; j++)
 		{
-	 	std::cout << iter << " from " << nrenders << std::endl;
-		for (int i = 0; i < 3; i++) up[i] = (float)rand() / (float)RAND_MAX;
-		eye = rand_point_on_unit_sphere();
-		eye.y = std::abs(eye.y);
-		std::cout << "v " << eye << std::endl;
+			zshader.vertex(i, j);
+		}
 
-		for (int i = width * height; i--; shadowbuffer[i] = zbuffer[i] = -std::numeric_limits<float>::max());
+		triangle(gl, zshader.varying_tri, zshader);
+	}
 
-		TGAImage frame(width, height, TGAImage::RGB);
-		lookat(eye, center, up);
-		viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
-		projection(0);
+	//gl.image.flip_vertically();
+	if (write_zbuffer) gl.image.write_tga_file("zbuffer.tga");
 
-		ZShader zshader;
-		for (int i = 0; i < model->nfaces(); i++)
+	//the depth of the first pass stays as the shadow buffer, the second one gets a new zbuffer
+	const float* shadowbuffer = gl.zbuffer;
+	gl.zbuffer = arena.allocate<float>(width * height);
+	gl.clear();
+	Shader shader(gl, shadowbuffer, occl);
+	occl.clear();
+	for (int i = 0; i < model->nfaces(); i++)
+	{
+		for (int j = 0; j < 3; j++)
 		{
-			for (int j = 0; j < 3; j++)
-			{
-				zshader.vertex(i, j);
-			}
-
-			triangle(zshader.varying_tri, zshader, frame, shadowbuffer);
+			shader.vertex(i, j);
 		}
 
-		
-		//frame.flip_vertically();
-		frame.write_tga_file("zbuffer.tga");
+		triangle(gl, shader.varying_tri, shader);
+	}
+}
 
-		
-		Shader shader;
-		occl.clear();
-		for (int i = 0; i < model->nfaces(); i++)
-		{
-			for (int j = 0; j < 3; j++)
-			{
-				shader.vertex(i, j);
-			}
+int main()
+{
+	model = new Model("../resources/diablo3_pose/diablo3_pose.obj", Model::ASYNC_TEXTURES);
 
-			triangle(shader.varying_tri, shader, frame, zbuffer);
-		}
+	//the views are drawn first so that rand() runs in the same order whatever the number of threads
+	const int nrenders = 100;
+	std::vector<vec3f> eyes, ups;
+	for (int iter = 1; iter <= nrenders; iter++)
+	{
+		std::cout << iter << " from " << nrenders << std::endl;
+		for (int i = 0; i < 3; i++) up[i] = (float)rand() / (float)RAND_MAX;
+		eye = rand_point_on_unit_sphere();
+		eye.y = std::abs(eye.y);
+		std::cout << "v " << eye << std::endl;
+		eyes.push_back(eye);
+		ups.push_back(up);
+	}
 
-		//occlusion gaussian blur
-		for (int i = 0; i < 1024; i++)
+	//views render in parallel, a batch at a time, and are averaged in order so the rounding doesn't change
+	ThreadPool& pool = ThreadPool::shared();
+	std::vector<TGAImage> occl(pool.size() + 1, TGAImage(1024, 1024, TGAImage::GRAYSCALE));
+	std::vector<FrameArena> arenas(occl.size());
+	for (int first = 0; first < nrenders; first += (int)occl.size())
+	{
+		const int n = std::min((int)occl.size(), nrenders - first);
+		pool.parallel_for(n, [&](std::size_t k) { bake_view(eyes[first + k], ups[first + k], occl[k], first + (int)k == nrenders - 1, arenas[k]); });
+
+		for (int k = 0; k < n; k++)
 		{
-			for (int j = 0; j < 1024; j++)
+			const int iter = first + k + 1;
+			//occlusion gaussian blur
+			for (int i = 0; i < 1024; i++)
 			{
-				float tmp = total.get(i, j)[0];
-				total.set(i, j, TGAColor((tmp * (iter - 1) + occl.get(i, j)[0]) / (float)iter + 0.5f));
+				for (int j = 0; j < 1024; j++)
+				{
+					float tmp = total.get(i, j)[0];
+					total.set(i, j, TGAColor((tmp * (iter - 1) + occl[k].get(i, j)[0]) / (float)iter + 0.5f));
+				}
 			}
 		}
+		if (first + n == nrenders) occl[n - 1].write_tga_file("occl.tga");
 	}
 	
 	total.write_tga_file("occlusion.tga");
-	occl.write_tga_file("occl.tga");
+	std::cerr << "# frame arena high water " << arenas[0].high_water() / 1024 << " KiB, capacity " << arenas[0].capacity() / 1024 << " KiB" << std::endl;
 	
 
 	//render model with AO image intensity
-	TGAImage newframe(width, height, TGAImage::RGB);
-	for (int i = width * height; i--;) { zbuffer[i] = -std::numeric_limits<float>::max(); }
 	eye = vec3f(1, 1, 4);
 	center = vec3f(0, 0, 0);
 	up = vec3f(0, 1, 0);
-	lookat(eye, center, up);
-	viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
-	projection(-1.f/(eye - center).norm());
-	AOShader aoshader;
+	RenderContext gl(width, height);
+	gl.lookat(eye, center, up);
+	gl.viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
+	gl.projection(-1.f/(eye - center).norm());
+	AOShader aoshader(gl);
 	if (aoshader.aoimage.read_tga_file("occlusion.tga") == false)
 	{
 		std::cout << "error " << std::endl;
@@ -197,15 +223,13 @@ int main()
 			aoshader.vertex(i, j);
 		}
 
-		triangle(aoshader.varying_tri, aoshader, newframe, zbuffer);
+		triangle(gl, aoshader.varying_tri, aoshader);
 	}
 
-	newframe.write_tga_file("Framebuffer2.tga");
+	gl.image.write_tga_file("Framebuffer2.tga");
 
 
-	delete []zbuffer;
-	delete[]shadowbuffer;
 	delete model;
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -3,25 +3,96 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <future>
 #include "geometry.h"
 #include "../common/tgaimage.h"
+#include "../common/bctexture.h"
+#include "../common/packed_vertices.h"
+#include "../common/mapped_file.h"
+#include "../common/thread_pool.h"
+#include "../common/huge_pages.h"
 
+//the three vertex indices of a triangle, points into the model's index buffer
+struct FaceRef
+{
+	const std::uint32_t* indices;
+
+	int size() const { return 3; }
+	std::uint32_t operator[](const int i) const { return indices[i]; }
+	const std::uint32_t* begin() const { return indices; }
+	const std::uint32_t* end() const { return indices + 3; }
+};
+
+//A run of at most 124 consecutive triangles using at most 64 vertices, with the bounds needed to skip
+//it as a whole: a bounding sphere, and a cone holding the normals of its triangles. The cluster faces
+//away from an eye at e when dot(normalize(cone_apex - e), cone_axis) >= cone_cutoff.
+struct Meshlet
+{
+	std::uint32_t first_face;
+	std::uint32_t nfaces;
+	vec3f center;
+	float radius;
+	vec3f cone_apex;
+	vec3f cone_axis;
+	float cone_cutoff; //above 1 when the triangles face too many ways to ever be culled
+};
+
+//Every distinct v/vt/vn triplet of the .obj becomes one vertex: verts_, uv_ and norms_ run in
+//parallel, and faces are fan triangulated into a flat index buffer, three indices per triangle.
+//Simplified LODs are more index buffers over the same vertices; the face accessors read the
+//triangles of the LOD picked by set_lod(). With COMPACT_VERTICES the three arrays are replaced by
+//16-byte quantized vertices once everything that needs full precision has run, and are decoded on fetch.
+//The texture maps decode on the shared thread pool while the mesh loads; with ASYNC_TEXTURES the
+//constructor returns as soon as the geometry is ready and wait_textures() must come before any lookup.
 class Model
 {
+	friend class ModelStream;
 private:
-	std::vector<vec3f> verts_;
-	std::vector<vec3f> norms_;
-	std::vector<vec2f> uv_;
-	std::vector<std::vector<vec3i>> faces_; //vec3i means v/vt/vn
+	huge_vector<vec3f> verts_;
+	huge_vector<vec3f> norms_;
+	huge_vector<vec2f> uv_;
+	PackedVertices packed_;
+	std::vector<std::uint32_t> indices_;
+	std::vector<std::vector<std::uint32_t>> lods_; //LOD 1 and coarser
+	std::vector<float> lod_errors_; //Hausdorff distance from each LOD to the full mesh, in model units
+	std::vector<std::vector<Meshlet>> meshlets_; //for every LOD
+	int lod_;
+	vec3f bbox_min_;
+	vec3f bbox_max_;
+	bool optimized_;
 	TGAImage diffusemap_;
 	TGAImage specularmap_;
 	TGAImage normalmap_;
+	BCTexture diffusebc_;
+	BCTexture normalbc_;
+	std::shared_future<void> textures_[3]; //diffuse, normal and specular jobs
+	void parse_obj(const char* begin, const char* end);
+	void optimize_mesh();
+	void generate_lods();
+	void build_meshlets();
+	void pack_vertices();
+	const std::vector<std::uint32_t>& lod_indices();
+	bool load_cache(const std::string& objfile, const std::string& cachefile, std::uint64_t& source_hash);
+	void save_cache(const std::string& objfile, const std::string& cachefile, const std::uint64_t source_hash);
 	void load_texture(std::string filename, const char* suffix, TGAImage& img);
+	void compress_texture(TGAImage& img, BCTexture& bc, const BCTexture::Format fmt);
 public:
-	Model(const char* filename);
+	enum LoadFlags { DEFAULT = 0, COMPRESS_TEXTURES = 1, NO_MESH_CACHE = 2, OPTIMIZE_MESH = 4, GENERATE_LODS = 8, COMPACT_VERTICES = 16, ASYNC_TEXTURES = 32 };
+
+	Model(); //no geometry nor textures, for ModelStream to fill
+	Model(const char* filename, const int flags = DEFAULT);
 	~Model();
+	static std::future<Model*> load_async(const char* filename, const int flags = DEFAULT); //ready with the geometry, the textures keep decoding
+	void wait_textures();
 	int nverts();
 	int nfaces();
+	FaceRef face(int iface);
+	const std::vector<std::uint32_t>& indices();
+	const std::vector<Meshlet>& meshlets();
+	int nlods();
+	void set_lod(int lod);
+	int select_lod(float screen_size, float pixel_error = 1.f); //coarsest LOD that is off by less than pixel_error when the model spans screen_size pixels
 	vec3f normal(int iface, int nthvert);
 	vec3f normal(vec2f uv);
 	vec3f vert(int i);
@@ -29,8 +100,30 @@ public:
 	vec2f uv(int iface, int nthvert);
 	TGAColor diffuse(vec2f uv);
 	float specular(vec2f uv);
-	std::vector<int> face(int idx);
+	vec3f bbox_min();
+	vec3f bbox_max();
 };
 
+//Reads a .obj too big to hold in memory a chunk of faces at a time. The constructor copies the v, vt and
+//vn records into temporary binary files and maps them; next() then refills a Model with the following
+//faces and the vertices they use, and drops the pages of text it went through. The heap holds one
+//chunk whatever the size of the file, the records are file pages the OS can evict at will.
+class ModelStream
+{
+private:
+	MappedFile obj_;
+	MappedFile records_[3]; //v, vt, vn as packed floats
+	std::string spill_[3];
+	size_t nrecords_[3];
+	size_t nread_[3]; //records before offset_, relative face indices count back from there
+	size_t offset_;
+	size_t chunk_faces_;
+	std::vector<vec3i> corners_;
+	bool spill(const std::string& prefix);
+public:
+	ModelStream(const char* filename, const size_t chunk_faces = 1 << 16);
+	~ModelStream();
+	bool next(Model& chunk); //false once all the faces were handed out
+};
 
 #endif //__MODEL_H_
\ No newline at end of file
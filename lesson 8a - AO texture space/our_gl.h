@@ -1,17 +1,33 @@
 #ifndef _OUR_GL_H
 #define _OUR_GL_H
 
+#include <cstdint>
+#include <vector>
 #include "../common/tgaimage.h"
+#include "../common/frame_arena.h"
 #include "geometry.h"
 
-extern Matrix ModelView;
-extern Matrix Projection;
-extern Matrix Viewport;
+class Model;
 
-
-void viewport(int x, int y, int w, int h);
-void projection(float coeff = 0.f); //coefficient = -1/c
-void lookat(vec3f eye, vec3f center, vec3f up);
+//the matrices viewport(), projection() and lookat() set, for fixed setups the first two can be built at compile time
+constexpr Matrix viewport_matrix(int x, int y, int w, int h)
+{
+	Matrix ret = Matrix::identity();
+	ret[0][3] = x + w / 2.f;
+	ret[1][3] = y + h / 2.f;
+	ret[2][3] = 1.f;
+	ret[0][0] = w / 2.f;
+	ret[1][1] = h / 2.f;
+	ret[2][2] = 0;
+	return ret;
+}
+constexpr Matrix projection_matrix(float coeff)
+{
+	Matrix ret = Matrix::identity();
+	ret[3][2] = coeff;
+	return ret;
+}
+Matrix lookat_matrix(vec3f eye, vec3f center, vec3f up);
 
 struct IShader
 {
@@ -20,7 +36,57 @@ struct IShader
 	virtual bool fragment(vec3f gl_fragcoord, vec3f bar, TGAColor& color) = 0;
 };
 
+struct RenderStats
+{
+	std::uint64_t triangles = 0; //went through triangle()
+	std::uint64_t fragments = 0; //passed the depth test and were shaded
+	std::uint64_t meshlets_culled = 0;
+};
+
+//Everything one render reads and writes: the matrices, a color target with its depth buffer and the counters.
+//Contexts share nothing, so renders with contexts of their own can run on as many threads at once; a context
+//is used by one thread at a time. Shaders that read the matrices should read them from the context they draw with.
+struct RenderContext
+{
+	RenderContext(int width, int height, int bpp = TGAImage::RGB); //black, depth at -max
+	RenderContext(int width, int height, FrameArena& arena, int bpp = TGAImage::RGB); //the same with both targets in the arena, until it is reset
+	RenderContext(const RenderContext&) = delete;
+	RenderContext& operator=(const RenderContext&) = delete;
+
+	Matrix ModelView;
+	Matrix Projection;
+	Matrix Viewport;
+	TGAImage image;
+	float* zbuffer; //width*height depths
+	RenderStats stats;
+
+	void viewport(int x, int y, int w, int h);
+	void projection(float coeff = 0.f); //coefficient = -1/c
+	void lookat(vec3f eye, vec3f center, vec3f up);
+	float screen_size(vec3f bbox_min, vec3f bbox_max) const; //largest side in pixels of the screen rectangle covering the box
+	void clear(); //targets and counters back to how the constructor left them
+private:
+	huge_vector<float> zstorage; //holds zbuffer when it isn't in an arena
+};
+
+void triangle(RenderContext& gl, mat<4, 3, float>& pts, IShader& shader);
+//Draws the current LOD of the model one meshlet at a time. Meshlets outside the image, and with
+//cull_backfaces those facing away from the eye, are skipped before any vertex() call; ModelView
+//must be a rigid motion, as lookat() makes it. Returns the number of triangles drawn.
+int draw(RenderContext& gl, Model& model, IShader& shader, bool cull_backfaces = true);
+
+//The original interface: one set of process wide matrices and targets passed on every call,
+//for single threaded code. It draws the same way as the functions above.
+extern Matrix ModelView;
+extern Matrix Projection;
+extern Matrix Viewport;
+
+void viewport(int x, int y, int w, int h);
+void projection(float coeff = 0.f);
+void lookat(vec3f eye, vec3f center, vec3f up);
+float screen_size(vec3f bbox_min, vec3f bbox_max);
 void triangle(mat<4, 3, float>& pts, IShader& shader, TGAImage& image, float* zbuffer);
+int draw(Model& model, IShader& shader, TGAImage& image, float* zbuffer, bool cull_backfaces = true);
 
 
 #endif //_OUR_GL_H
\ No newline at end of file
@@ -4,3 +4,40 @@ template<> template<> vec<3, int> ::vec(const vec<3, float>& v) : x(int(v.x + 0.
 template<> template<> vec<3, float>::vec(const vec<3, int>& v) : x(v.x), y(v.y), z(v.z) {}
 template<> template<> vec<2, int> ::vec(const vec<2, float>& v) : x(int(v.x + 0.5f)), y(int(v.y + 0.5f)) {}
 template<> template<> vec<2, float>::vec(const vec<2, int>& v) : x(v.x), y(v.y) {}
+
+//compile-time checks of the constexpr math; with SSE these go through the scalar side of the vec4f and Matrix operators
+static constexpr Matrix translation(const float x, const float y, const float z)
+{
+	Matrix ret = Matrix::identity();
+	ret[0][3] = x;
+	ret[1][3] = y;
+	ret[2][3] = z;
+	return ret;
+}
+
+static constexpr mat<3, 3, float> diagonal(const float x, const float y, const float z)
+{
+	mat<3, 3, float> ret;
+	ret[0][0] = x;
+	ret[1][1] = y;
+	ret[2][2] = z;
+	return ret;
+}
+
+constexpr Matrix shift = translation(1, 2, 3);
+constexpr vec4f shifted = shift * embed<4>(vec3f(1, 1, 1));
+static_assert(shifted[0] == 2 && shifted[1] == 3 && shifted[2] == 4 && shifted[3] == 1, "Matrix * vec4f");
+static_assert((shift * translation(-1, -2, -3))[1][3] == 0, "Matrix * Matrix");
+static_assert(shift.transpose()[3][2] == 3 && shift.transpose()[2][3] == 0, "Matrix transpose");
+static_assert(shift.det() == 1 && diagonal(2, 4, 8).det() == 64, "determinant");
+static_assert(diagonal(2, 4, 8).invert()[2][2] == 0.125f && diagonal(2, 4, 8).invert_transpose()[0][1] == 0, "3x3 inverse");
+static_assert(cross(vec3f(1, 0, 0), vec3f(0, 1, 0)).z == 1 && proj<2>(vec3f(1, 2, 3))[1] == 2, "cross, proj");
+static_assert(shifted * vec4f() == 0 && (shifted - shifted / 2.f)[2] == 2, "vec4f arithmetic");
+
+static constexpr mat<4, 3, float> clip_coordinates()
+{
+	mat<4, 3, float> ret;
+	for (int i = 3; i--;) ret.set_col(i, embed<4>(vec3f(float(i), 1, 2)));
+	return ret;
+}
+static_assert((shift * clip_coordinates()).transpose()[2][0] == 3 && (shift * clip_coordinates()).transpose()[1][3] == 1, "4x3 clip coordinates");
@@ -6,6 +6,15 @@
 #include <cassert>
 #include <iostream>
 
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define GEOMETRY_SSE
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#define GEOMETRY_AVX
+#endif
+
 
 template <size_t DimCols, size_t DimRows, typename T> class mat;
 
@@ -13,10 +22,10 @@ template<size_t DIM, typename T>
 
 struct vec
 {
-	vec() { for (size_t i = DIM; i--; data_[i] = T()); }
+	constexpr vec() : data_() {}
 
-	T& operator[](const size_t i) { assert(i < DIM); return data_[i]; }
-	const T& operator[](const size_t i) const { assert(i < DIM); return data_[i]; }
+	constexpr T& operator[](const size_t i) { assert(i < DIM); return data_[i]; }
+	constexpr const T& operator[](const size_t i) const { assert(i < DIM); return data_[i]; }
 private:
 	T data_[DIM];
 };
@@ -26,11 +35,11 @@ private:
 template<typename T> 
 struct vec<2, T>
 {
-	vec() : x(T()), y(T()) {}
-	vec(T X, T Y) : x(X), y(Y) {}
+	constexpr vec() : x(T()), y(T()) {}
+	constexpr vec(T X, T Y) : x(X), y(Y) {}
 	template<class U> vec<2, T>(const vec<2, U>& v);
-	T& operator[](const size_t i) { assert(i < 2); return i <= 0 ? x : y; }
-	const T& operator[](const size_t i) const { assert(i < 2); return i <= 0 ? x : y; }
+	constexpr T& operator[](const size_t i) { assert(i < 2); return i <= 0 ? x : y; }
+	constexpr const T& operator[](const size_t i) const { assert(i < 2); return i <= 0 ? x : y; }
 	float norm() { return std::sqrt(x * x + y * y ); }
 
 	T x, y;
@@ -41,11 +50,11 @@ struct vec<2, T>
 template<typename T>
 struct vec<3, T>
 {
-	vec() : x(T()), y(T()) , z(T()) {}
-	vec(T X, T Y , T Z) : x(X), y(Y),z(Z) {}
+	constexpr vec() : x(T()), y(T()) , z(T()) {}
+	constexpr vec(T X, T Y , T Z) : x(X), y(Y),z(Z) {}
 	template<class U> vec<3, T>(const vec<3, U>& v);
-	T& operator[](const size_t i) { assert(i < 3); return (i <= 0 ? x : (1 == i ? y : z)); }
-	const T& operator[](const size_t i) const { assert(i < 3); return (i <= 0 ? x : (1 == i ? y : z)); }
+	constexpr T& operator[](const size_t i) { assert(i < 3); return (i <= 0 ? x : (1 == i ? y : z)); }
+	constexpr const T& operator[](const size_t i) const { assert(i < 3); return (i <= 0 ? x : (1 == i ? y : z)); }
 	float norm() { return std::sqrt(x * x + y * y + z * z); }
 	vec<3, T>& normalize(T l = 1) { *this = (*this) * (l / norm()); return *this; }
 
@@ -54,52 +63,52 @@ struct vec<3, T>
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-template<size_t DIM, typename T> T operator*(const vec<DIM, T>& lhs, const vec<DIM, T>& rhs)
+template<size_t DIM, typename T> constexpr T operator*(const vec<DIM, T>& lhs, const vec<DIM, T>& rhs)
 {
 	T res = T();
 	for (int i = DIM; i--; res += lhs[i] * rhs[i]);
 	return res;
 }
 
-template<size_t DIM, typename T> vec<DIM, T> operator+(vec<DIM, T> lhs, const vec<DIM, T>& rhs)
+template<size_t DIM, typename T> constexpr vec<DIM, T> operator+(vec<DIM, T> lhs, const vec<DIM, T>& rhs)
 {
 	for (size_t i = DIM; i--; lhs[i] += rhs[i]);
 	return lhs;
 }
 
-template<size_t DIM, typename T> vec<DIM, T> operator-(vec<DIM, T> lhs, const vec<DIM, T>& rhs)
+template<size_t DIM, typename T> constexpr vec<DIM, T> operator-(vec<DIM, T> lhs, const vec<DIM, T>& rhs)
 {
 	for (size_t i = DIM; i--; lhs[i] -= rhs[i]);
 	return lhs;
 }
 
-template<size_t DIM, typename T, typename U> vec<DIM, T> operator*(vec<DIM, T> lhs, const U& rhs)
+template<size_t DIM, typename T, typename U> constexpr vec<DIM, T> operator*(vec<DIM, T> lhs, const U& rhs)
 {
 	for (size_t i = DIM; i--; lhs[i] *= rhs);
 	return lhs;
 }
 
-template<size_t DIM, typename T, typename U> vec<DIM, T> operator/(vec<DIM, T> lhs, const U& rhs)
+template<size_t DIM, typename T, typename U> constexpr vec<DIM, T> operator/(vec<DIM, T> lhs, const U& rhs)
 {
 	for (size_t i = DIM; i--; lhs[i] /= rhs);
 	return lhs;
 }
 
-template<size_t LEN, size_t DIM, typename T> vec<LEN, T> embed(const vec<DIM, T>& v, T fill = 1)
+template<size_t LEN, size_t DIM, typename T> constexpr vec<LEN, T> embed(const vec<DIM, T>& v, T fill = 1)
 {
 	vec<LEN, T> ret;
 	for (int i = LEN; i--; ret[i] = (i < DIM ? v[i] : fill));
 	return ret;
 }
 
-template<size_t LEN, size_t DIM, typename T> vec<LEN, T> proj(const vec<DIM, T>& v)
+template<size_t LEN, size_t DIM, typename T> constexpr vec<LEN, T> proj(const vec<DIM, T>& v)
 {
 	vec<LEN, T> ret;
 	for (size_t i = LEN; i--; ret[i] = v[i]);
 	return ret;
 }
 
-template<typename T> vec<3, T> cross(vec<3, T> v1, vec<3, T> v2)
+template<typename T> constexpr vec<3, T> cross(vec<3, T> v1, vec<3, T> v2)
 {
 	return vec<3, T>(v1.y * v2.z - v1.z * v2.y, v1.z * v2.x - v1.x * v2.z, v1.x * v2.y - v1.y * v2.x);
 }
@@ -117,7 +126,7 @@ template<size_t DIM, typename T> std::ostream& operator<<(std::ostream& out, vec
 
 template<size_t DIM, typename T> struct dt
 {
-	static T det(const mat<DIM, DIM, T>& src)
+	static constexpr T det(const mat<DIM, DIM, T>& src)
 	{
 		T ret = 0;
 		for (size_t i = DIM; i--; ret += src[0][i] * src.cofactor(0, i));
@@ -127,30 +136,154 @@ template<size_t DIM, typename T> struct dt
 
 template<typename T> struct dt<1, T>
 {
-	static T det(const mat<1, 1, T>& src)
+	static constexpr T det(const mat<1, 1, T>& src)
 	{
 		return src[0][0];
 	}
 };
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+template<size_t DIM, typename T> struct inv
+{
+	static constexpr mat<DIM, DIM, T> invert_transpose(const mat<DIM, DIM, T>& src)
+	{
+		mat<DIM, DIM, T> ret = src.adjugate();
+		return ret / (ret[0] * src[0]);
+	}
+
+	static constexpr mat<DIM, DIM, T> invert(const mat<DIM, DIM, T>& src)
+	{
+		return invert_transpose(src).transpose();
+	}
+
+	static constexpr mat<DIM, DIM, T> invert_affine(const mat<DIM, DIM, T>& src)
+	{
+		mat<DIM - 1, DIM - 1, T> linear = src.get_minor(DIM - 1, DIM - 1).invert();
+		vec<DIM - 1, T> translation = proj<DIM - 1>(src.col(DIM - 1));
+		mat<DIM, DIM, T> ret = mat<DIM, DIM, T>::identity();
+		for (size_t i = DIM - 1; i--;)
+		{
+			for (size_t j = DIM - 1; j--; ret[i][j] = linear[i][j]);
+			ret[i][DIM - 1] = -(linear[i] * translation);
+		}
+		return ret;
+	}
+};
+
+//the rows of the cofactor matrix of a 3x3 are cross products of its rows
+template<typename T> struct inv<3, T>
+{
+	static constexpr mat<3, 3, T> invert_transpose(const mat<3, 3, T>& src)
+	{
+		mat<3, 3, T> ret;
+		ret[0] = cross(src[1], src[2]);
+		ret[1] = cross(src[2], src[0]);
+		ret[2] = cross(src[0], src[1]);
+		const T inv_det = T(1) / (ret[0] * src[0]);
+		for (size_t i = 3; i--; ret[i] = ret[i] * inv_det);
+		return ret;
+	}
+
+	static constexpr mat<3, 3, T> invert(const mat<3, 3, T>& src)
+	{
+		return invert_transpose(src).transpose();
+	}
+
+	static constexpr mat<3, 3, T> invert_affine(const mat<3, 3, T>& src)
+	{
+		const T inv_det = T(1) / (src[0][0] * src[1][1] - src[0][1] * src[1][0]);
+		mat<3, 3, T> ret = mat<3, 3, T>::identity();
+		ret[0][0] = src[1][1] * inv_det;
+		ret[0][1] = -src[0][1] * inv_det;
+		ret[1][0] = -src[1][0] * inv_det;
+		ret[1][1] = src[0][0] * inv_det;
+		ret[0][2] = -(ret[0][0] * src[0][2] + ret[0][1] * src[1][2]);
+		ret[1][2] = -(ret[1][0] * src[0][2] + ret[1][1] * src[1][2]);
+		return ret;
+	}
+};
+
+//every 3x3 minor of a 4x4 expands into 2x2 determinants of its top two rows (s) and its bottom two (c)
+template<typename T> struct inv<4, T>
+{
+	static constexpr mat<4, 4, T> invert_transpose(const mat<4, 4, T>& m)
+	{
+		const T s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+		const T s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+		const T s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+		const T s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+		const T s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+		const T s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+		const T c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+		const T c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+		const T c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+		const T c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+		const T c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+		const T c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+
+		mat<4, 4, T> ret;
+		ret[0][0] = m[1][1] * c5 - m[1][2] * c4 + m[1][3] * c3;
+		ret[1][0] = -m[0][1] * c5 + m[0][2] * c4 - m[0][3] * c3;
+		ret[2][0] = m[3][1] * s5 - m[3][2] * s4 + m[3][3] * s3;
+		ret[3][0] = -m[2][1] * s5 + m[2][2] * s4 - m[2][3] * s3;
+		ret[0][1] = -m[1][0] * c5 + m[1][2] * c2 - m[1][3] * c1;
+		ret[1][1] = m[0][0] * c5 - m[0][2] * c2 + m[0][3] * c1;
+		ret[2][1] = -m[3][0] * s5 + m[3][2] * s2 - m[3][3] * s1;
+		ret[3][1] = m[2][0] * s5 - m[2][2] * s2 + m[2][3] * s1;
+		ret[0][2] = m[1][0] * c4 - m[1][1] * c2 + m[1][3] * c0;
+		ret[1][2] = -m[0][0] * c4 + m[0][1] * c2 - m[0][3] * c0;
+		ret[2][2] = m[3][0] * s4 - m[3][1] * s2 + m[3][3] * s0;
+		ret[3][2] = -m[2][0] * s4 + m[2][1] * s2 - m[2][3] * s0;
+		ret[0][3] = -m[1][0] * c3 + m[1][1] * c1 - m[1][2] * c0;
+		ret[1][3] = m[0][0] * c3 - m[0][1] * c1 + m[0][2] * c0;
+		ret[2][3] = -m[3][0] * s3 + m[3][1] * s1 - m[3][2] * s0;
+		ret[3][3] = m[2][0] * s3 - m[2][1] * s1 + m[2][2] * s0;
+		const T inv_det = T(1) / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+		for (size_t i = 4; i--; ret[i] = ret[i] * inv_det);
+		return ret;
+	}
+
+	static constexpr mat<4, 4, T> invert(const mat<4, 4, T>& m)
+	{
+		return invert_transpose(m).transpose();
+	}
+
+	//the columns of the inverse of the linear part are the cross products of its rows over the determinant
+	static constexpr mat<4, 4, T> invert_affine(const mat<4, 4, T>& m)
+	{
+		const vec<3, T> r0 = proj<3>(m[0]), r1 = proj<3>(m[1]), r2 = proj<3>(m[2]);
+		const vec<3, T> c[3] = { cross(r1, r2), cross(r2, r0), cross(r0, r1) };
+		const vec<3, T> translation(m[0][3], m[1][3], m[2][3]);
+		const T inv_det = T(1) / (c[0] * r0);
+		mat<4, 4, T> ret = mat<4, 4, T>::identity();
+		for (size_t i = 3; i--;)
+		{
+			const vec<3, T> row = vec<3, T>(c[0][i], c[1][i], c[2][i]) * inv_det;
+			for (size_t j = 3; j--; ret[i][j] = row[j]);
+			ret[i][3] = -(row * translation);
+		}
+		return ret;
+	}
+};
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 template<size_t DimRows, size_t DimCols, typename T> class mat
 {
 	vec<DimCols, T> rows[DimRows];
 public:
-	mat() {}
-	vec<DimCols, T>& operator[](const size_t idx)
+	constexpr mat() {}
+	constexpr vec<DimCols, T>& operator[](const size_t idx)
 	{
 		assert(idx < DimRows);
 		return rows[idx];
 	}
-	const vec<DimCols, T>& operator[](const size_t idx) const
+	constexpr const vec<DimCols, T>& operator[](const size_t idx) const
 	{
 		assert(idx < DimRows);
 		return rows[idx];
 	}
 
-	vec<DimRows, T> col(const size_t idx) const
+	constexpr vec<DimRows, T> col(const size_t idx) const
 	{
 		assert(idx < DimCols);
 		vec<DimRows, T> ret;
@@ -158,13 +291,13 @@ public:
 		return ret;
 	}
 
-	void set_col(size_t idx, vec<DimRows, T> v)
+	constexpr void set_col(size_t idx, vec<DimRows, T> v)
 	{
 		assert(idx < DimCols);
 		for (int i = DimRows; i--; rows[i][idx] = v[i]);
 	}
 
-	static mat<DimRows, DimCols, T> identity()
+	static constexpr mat<DimRows, DimCols, T> identity()
 	{
 		mat<DimRows, DimCols, T> ret;
 		for (size_t i = DimRows; i--;)
@@ -174,12 +307,12 @@ public:
 		return ret;
 	}
 
-	T det() const
+	constexpr T det() const
 	{
 		return dt<DimCols, T>::det(*this);
 	}
 
-	mat<DimRows - 1, DimCols - 1, T> get_minor(size_t row, size_t col) const
+	constexpr mat<DimRows - 1, DimCols - 1, T> get_minor(size_t row, size_t col) const
 	{
 		mat<DimRows - 1, DimCols - 1, T> ret;
 		for (size_t i = DimRows - 1; i--;)
@@ -189,12 +322,12 @@ public:
 		return ret;
 	}
 
-	T cofactor(size_t row, size_t col) const
+	constexpr T cofactor(size_t row, size_t col) const
 	{
 		return get_minor(row, col).det()* ((row + col) % 2 ? -1 : 1);
 	}
 
-	mat<DimRows, DimCols, T> adjugate() const
+	constexpr mat<DimRows, DimCols, T> adjugate() const
 	{
 		mat<DimRows, DimCols, T> ret;
 		for (size_t i = DimRows; i--;)
@@ -204,19 +337,23 @@ public:
 		return ret;
 	}
 
-	mat<DimRows, DimCols, T> invert_transpose()
+	constexpr mat<DimRows, DimCols, T> invert_transpose() const
 	{
-		mat<DimRows, DimCols, T> ret = adjugate();
-		T tmp = ret[0] * rows[0];
-		return ret / tmp;
+		return inv<DimCols, T>::invert_transpose(*this);
 	}
 
-	mat<DimCols, DimRows, T> invert()
+	constexpr mat<DimCols, DimRows, T> invert() const
 	{
-		return invert_transpose().transpose();
+		return inv<DimCols, T>::invert(*this);
 	}
 
-	mat<DimCols, DimRows, T> transpose()
+	//for a last row of 0 ... 0 1, like ModelView: inverts the linear part and applies it to the negated translation
+	constexpr mat<DimRows, DimCols, T> invert_affine() const
+	{
+		return inv<DimCols, T>::invert_affine(*this);
+	}
+
+	constexpr mat<DimCols, DimRows, T> transpose() const
 	{
 		mat<DimCols, DimRows, T> ret;
 		for (size_t i = DimCols; i--; ret[i] = this->col(i));
@@ -226,14 +363,14 @@ public:
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-template<size_t DimRows, size_t DimCols, typename T> vec<DimRows, T> operator*(const mat<DimRows, DimCols, T>& lhs, const vec<DimCols, T>& rhs)
+template<size_t DimRows, size_t DimCols, typename T> constexpr vec<DimRows, T> operator*(const mat<DimRows, DimCols, T>& lhs, const vec<DimCols, T>& rhs)
 {
 	vec<DimRows, T> ret;
 	for (size_t i = DimRows; i--; ret[i] = lhs[i] * rhs);
 	return ret;
 }
 
-template<size_t R1, size_t C1, size_t C2, typename T> mat<R1, C2, T>operator*(mat<R1, C1, T>& lhs, mat<C1, C2, T>& rhs)
+template<size_t R1, size_t C1, size_t C2, typename T> constexpr mat<R1, C2, T>operator*(const mat<R1, C1, T>& lhs, const mat<C1, C2, T>& rhs)
 {
 	mat<R1, C2, T> result;
 	for (size_t i = R1; i--;)
@@ -244,9 +381,9 @@ template<size_t R1, size_t C1, size_t C2, typename T> mat<R1, C2, T>operator*(ma
 	return result;
 }
 
-template<size_t DimRows, size_t DimCols, typename T> mat<DimRows, DimCols, T> operator/(mat<DimRows, DimCols, T> lhs, const T& rhs)
+template<size_t DimRows, size_t DimCols, typename T> constexpr mat<DimRows, DimCols, T> operator/(mat<DimRows, DimCols, T> lhs, const T& rhs)
 {
-	for (size_t i = DimRows; i--; lhs[i] / rhs);
+	for (size_t i = DimRows; i--; lhs[i] = lhs[i] / rhs);
 	return lhs;
 }
 
@@ -256,6 +393,325 @@ template<size_t DimRows, size_t DimCols, typename T> std::ostream& operator<<(st
 	return out;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SSE versions of what every vertex goes through: vec4f, Matrix and the 4x3 clip coordinates of a triangle. They keep
+// the interface of the generic templates and sum products in the same order, so results don't change. 32-bit MSVC
+// can't pass 16-byte aligned types by value and keeps the generic code, as does everything without SSE.
+// Intrinsics can't run in a constant expression, there the same operations take a scalar path instead; the 4x4
+// inverses are runtime only.
+
+#ifdef GEOMETRY_SSE
+constexpr bool constant_evaluated()
+{
+	return __builtin_is_constant_evaluated();
+}
+
+template<> struct vec<4, float>
+{
+	constexpr vec() : data_() {}
+	explicit vec(const __m128 m) { _mm_store_ps(data_, m); }
+	constexpr float& operator[](const size_t i) { assert(i < 4); return data_[i]; }
+	constexpr const float& operator[](const size_t i) const { assert(i < 4); return data_[i]; }
+	__m128 simd() const { return _mm_load_ps(data_); }
+private:
+	alignas(16) float data_[4];
+};
+
+constexpr float operator*(const vec<4, float>& lhs, const vec<4, float>& rhs)
+{
+	if (!constant_evaluated())
+	{
+		const __m128 p = _mm_mul_ps(lhs.simd(), rhs.simd());
+		__m128 res = _mm_add_ss(_mm_setzero_ps(), _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3)));
+		res = _mm_add_ss(res, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2)));
+		res = _mm_add_ss(res, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1)));
+		return _mm_cvtss_f32(_mm_add_ss(res, p));
+	}
+	float res = 0;
+	for (size_t i = 4; i--; res += lhs[i] * rhs[i]);
+	return res;
+}
+
+constexpr vec<4, float> operator+(vec<4, float> lhs, const vec<4, float>& rhs)
+{
+	if (!constant_evaluated()) return vec<4, float>(_mm_add_ps(lhs.simd(), rhs.simd()));
+	for (size_t i = 4; i--; lhs[i] += rhs[i]);
+	return lhs;
+}
+
+constexpr vec<4, float> operator-(vec<4, float> lhs, const vec<4, float>& rhs)
+{
+	if (!constant_evaluated()) return vec<4, float>(_mm_sub_ps(lhs.simd(), rhs.simd()));
+	for (size_t i = 4; i--; lhs[i] -= rhs[i]);
+	return lhs;
+}
+
+constexpr vec<4, float> operator*(vec<4, float> lhs, const float rhs)
+{
+	if (!constant_evaluated()) return vec<4, float>(_mm_mul_ps(lhs.simd(), _mm_set1_ps(rhs)));
+	for (size_t i = 4; i--; lhs[i] *= rhs);
+	return lhs;
+}
+
+constexpr vec<4, float> operator/(vec<4, float> lhs, const float rhs)
+{
+	if (!constant_evaluated()) return vec<4, float>(_mm_div_ps(lhs.simd(), _mm_set1_ps(rhs)));
+	for (size_t i = 4; i--; lhs[i] /= rhs);
+	return lhs;
+}
+
+//one row of a product, lhs[3] * r3 + ... + lhs[0] * r0 in the order of the dot product above
+inline __m128 sse_row_product(const __m128 lhs, const __m128 r0, const __m128 r1, const __m128 r2, const __m128 r3)
+{
+	__m128 res = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(3, 3, 3, 3)), r3));
+	res = _mm_add_ps(res, _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(2, 2, 2, 2)), r2));
+	res = _mm_add_ps(res, _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(1, 1, 1, 1)), r1));
+	return _mm_add_ps(res, _mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(0, 0, 0, 0)), r0));
+}
+
+//_MM_TRANSPOSE4_PS declares variables without initializers on some compilers, which a constexpr function can't hold
+inline void sse_transpose(__m128& r0, __m128& r1, __m128& r2, __m128& r3)
+{
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+}
+
+template<> constexpr mat<4, 4, float> mat<4, 4, float>::transpose() const
+{
+	mat<4, 4, float> ret;
+	if (!constant_evaluated())
+	{
+		__m128 r0 = rows[0].simd(), r1 = rows[1].simd(), r2 = rows[2].simd(), r3 = rows[3].simd();
+		sse_transpose(r0, r1, r2, r3);
+		ret[0] = vec<4, float>(r0);
+		ret[1] = vec<4, float>(r1);
+		ret[2] = vec<4, float>(r2);
+		ret[3] = vec<4, float>(r3);
+		return ret;
+	}
+	for (size_t i = 4; i--; ret[i] = col(i));
+	return ret;
+}
+
+constexpr vec<4, float> operator*(const mat<4, 4, float>& lhs, const vec<4, float>& rhs)
+{
+	vec<4, float> ret;
+	if (!constant_evaluated())
+	{
+		const __m128 v = rhs.simd();
+		__m128 p0 = _mm_mul_ps(lhs[0].simd(), v), p1 = _mm_mul_ps(lhs[1].simd(), v), p2 = _mm_mul_ps(lhs[2].simd(), v), p3 = _mm_mul_ps(lhs[3].simd(), v);
+		sse_transpose(p0, p1, p2, p3);
+		return vec<4, float>(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_setzero_ps(), p3), p2), p1), p0));
+	}
+	for (size_t i = 4; i--; ret[i] = lhs[i] * rhs);
+	return ret;
+}
+
+constexpr mat<4, 4, float> operator*(const mat<4, 4, float>& lhs, const mat<4, 4, float>& rhs)
+{
+	mat<4, 4, float> result;
+	if (!constant_evaluated())
+	{
+		const __m128 r0 = rhs[0].simd(), r1 = rhs[1].simd(), r2 = rhs[2].simd(), r3 = rhs[3].simd();
+		for (size_t i = 4; i--; result[i] = vec<4, float>(sse_row_product(lhs[i].simd(), r0, r1, r2, r3)));
+		return result;
+	}
+	for (size_t i = 4; i--;)
+	{
+		for (size_t j = 4; j--; result[i][j] = lhs[i] * rhs.col(j));
+	}
+	return result;
+}
+
+//2x2 blocks are kept in one register as (a b c d) for | a b |
+//                                                      | c d |
+inline __m128 sse_mat2_mul(const __m128 lhs, const __m128 rhs) //lhs * rhs
+{
+	return _mm_add_ps(_mm_mul_ps(lhs, _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(3, 0, 3, 0))),
+		_mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+inline __m128 sse_mat2_adj_mul(const __m128 lhs, const __m128 rhs) //adjugate(lhs) * rhs
+{
+	return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(0, 0, 3, 3)), rhs),
+		_mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+
+inline __m128 sse_mat2_mul_adj(const __m128 lhs, const __m128 rhs) //lhs * adjugate(rhs)
+{
+	return _mm_sub_ps(_mm_mul_ps(lhs, _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(0, 3, 0, 3))),
+		_mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+//w of the result is 0 for finite input
+inline __m128 sse_cross(const __m128 lhs, const __m128 rhs)
+{
+	return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(3, 0, 2, 1)), _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(3, 1, 0, 2))),
+		_mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(3, 1, 0, 2)), _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(3, 0, 2, 1))));
+}
+
+//blockwise inverse of | A B |, the blocks of the inverse come out as adjugates scaled by 1/det: x = adj(X) and so on
+//                     | C D |
+inline void sse_inverse_blocks(const mat<4, 4, float>& m, __m128& x, __m128& y, __m128& z, __m128& w)
+{
+	const __m128 r0 = m[0].simd(), r1 = m[1].simd(), r2 = m[2].simd(), r3 = m[3].simd();
+	const __m128 a = _mm_movelh_ps(r0, r1), b = _mm_movehl_ps(r1, r0), c = _mm_movelh_ps(r2, r3), d = _mm_movehl_ps(r3, r2);
+	const __m128 dets = _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0)))); //|A| |B| |C| |D|
+	const __m128 det_a = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(0, 0, 0, 0)), det_b = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(1, 1, 1, 1));
+	const __m128 det_c = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(2, 2, 2, 2)), det_d = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(3, 3, 3, 3));
+
+	const __m128 dc = sse_mat2_adj_mul(d, c);
+	const __m128 ab = sse_mat2_adj_mul(a, b);
+	x = _mm_sub_ps(_mm_mul_ps(det_d, a), sse_mat2_mul(b, dc));
+	w = _mm_sub_ps(_mm_mul_ps(det_a, d), sse_mat2_mul(c, ab));
+	y = _mm_sub_ps(_mm_mul_ps(det_b, c), sse_mat2_mul_adj(d, ab));
+	z = _mm_sub_ps(_mm_mul_ps(det_c, b), sse_mat2_mul_adj(a, dc));
+
+	//|M| = |A||D| + |B||C| - trace(adj(A)B adj(D)C)
+	__m128 tr = _mm_mul_ps(ab, _mm_shuffle_ps(dc, dc, _MM_SHUFFLE(3, 1, 2, 0)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 0, 3, 2)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(2, 3, 0, 1)));
+	const __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c)), tr);
+	const __m128 scale = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), det);
+	x = _mm_mul_ps(x, scale);
+	y = _mm_mul_ps(y, scale);
+	z = _mm_mul_ps(z, scale);
+	w = _mm_mul_ps(w, scale);
+}
+
+template<> struct inv<4, float>
+{
+	static mat<4, 4, float> invert_transpose(const mat<4, 4, float>& m)
+	{
+		__m128 x, y, z, w;
+		sse_inverse_blocks(m, x, y, z, w);
+		mat<4, 4, float> ret;
+		ret[0] = vec<4, float>(_mm_shuffle_ps(x, z, _MM_SHUFFLE(2, 3, 2, 3)));
+		ret[1] = vec<4, float>(_mm_shuffle_ps(x, z, _MM_SHUFFLE(0, 1, 0, 1)));
+		ret[2] = vec<4, float>(_mm_shuffle_ps(y, w, _MM_SHUFFLE(2, 3, 2, 3)));
+		ret[3] = vec<4, float>(_mm_shuffle_ps(y, w, _MM_SHUFFLE(0, 1, 0, 1)));
+		return ret;
+	}
+
+	static mat<4, 4, float> invert(const mat<4, 4, float>& m)
+	{
+		__m128 x, y, z, w;
+		sse_inverse_blocks(m, x, y, z, w);
+		mat<4, 4, float> ret;
+		ret[0] = vec<4, float>(_mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+		ret[1] = vec<4, float>(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+		ret[2] = vec<4, float>(_mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+		ret[3] = vec<4, float>(_mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+		return ret;
+	}
+
+	static mat<4, 4, float> invert_affine(const mat<4, 4, float>& m)
+	{
+		const __m128 r0 = m[0].simd(), r1 = m[1].simd(), r2 = m[2].simd();
+		__m128 c0 = sse_cross(r1, r2), c1 = sse_cross(r2, r0), c2 = sse_cross(r0, r1);
+		__m128 det = _mm_mul_ps(c0, r0);
+		det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(1, 0, 3, 2)));
+		det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(2, 3, 0, 1)));
+		const __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.f), det);
+		c0 = _mm_mul_ps(c0, inv_det);
+		c1 = _mm_mul_ps(c1, inv_det);
+		c2 = _mm_mul_ps(c2, inv_det);
+		__m128 t = _mm_mul_ps(c0, _mm_shuffle_ps(r0, r0, _MM_SHUFFLE(3, 3, 3, 3)));
+		t = _mm_add_ps(t, _mm_mul_ps(c1, _mm_shuffle_ps(r1, r1, _MM_SHUFFLE(3, 3, 3, 3))));
+		t = _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(t, _mm_mul_ps(c2, _mm_shuffle_ps(r2, r2, _MM_SHUFFLE(3, 3, 3, 3)))));
+		_MM_TRANSPOSE4_PS(c0, c1, c2, t); //the w lanes of the cross products are 0, so the last row is too
+		mat<4, 4, float> ret;
+		ret[0] = vec<4, float>(c0);
+		ret[1] = vec<4, float>(c1);
+		ret[2] = vec<4, float>(c2);
+		ret[3][3] = 1.f;
+		return ret;
+	}
+};
+
+//rows are padded to 16 bytes so that each one loads into a register, the padding stays out of the interface
+template<> class mat<4, 3, float>
+{
+	struct alignas(16) padded_row
+	{
+		vec<3, float> v;
+		float pad = 0;
+	};
+	padded_row rows[4];
+public:
+	constexpr mat() {}
+	constexpr vec<3, float>& operator[](const size_t idx)
+	{
+		assert(idx < 4);
+		return rows[idx].v;
+	}
+	constexpr const vec<3, float>& operator[](const size_t idx) const
+	{
+		assert(idx < 4);
+		return rows[idx].v;
+	}
+
+	constexpr vec<4, float> col(const size_t idx) const
+	{
+		assert(idx < 3);
+		vec<4, float> ret;
+		for (size_t i = 4; i--; ret[i] = rows[i].v[idx]);
+		return ret;
+	}
+
+	constexpr void set_col(size_t idx, vec<4, float> v)
+	{
+		assert(idx < 3);
+		for (int i = 4; i--; rows[i].v[idx] = v[i]);
+	}
+
+	static constexpr mat<4, 3, float> identity()
+	{
+		mat<4, 3, float> ret;
+		for (size_t i = 4; i--;)
+		{
+			for (size_t j = 3; j--; ret[i][j] = (i == j));
+		}
+		return ret;
+	}
+
+	constexpr mat<3, 4, float> transpose() const
+	{
+		mat<3, 4, float> ret;
+		if (!constant_evaluated())
+		{
+			__m128 r0 = simd(0), r1 = simd(1), r2 = simd(2), r3 = simd(3);
+			sse_transpose(r0, r1, r2, r3);
+			ret[0] = vec<4, float>(r0);
+			ret[1] = vec<4, float>(r1);
+			ret[2] = vec<4, float>(r2);
+			return ret;
+		}
+		for (size_t i = 3; i--; ret[i] = col(i));
+		return ret;
+	}
+
+	__m128 simd(const size_t idx) const { return _mm_load_ps(&rows[idx].v.x); }
+	void set_simd(const size_t idx, const __m128 m) { _mm_store_ps(&rows[idx].v.x, m); }
+};
+
+constexpr mat<4, 3, float> operator*(const mat<4, 4, float>& lhs, const mat<4, 3, float>& rhs)
+{
+	mat<4, 3, float> result;
+	if (!constant_evaluated())
+	{
+		const __m128 r0 = rhs.simd(0), r1 = rhs.simd(1), r2 = rhs.simd(2), r3 = rhs.simd(3);
+		for (size_t i = 4; i--; result.set_simd(i, sse_row_product(lhs[i].simd(), r0, r1, r2, r3)));
+		return result;
+	}
+	for (size_t i = 4; i--;)
+	{
+		for (size_t j = 3; j--; result[i][j] = lhs[i] * rhs.col(j));
+	}
+	return result;
+}
+#endif
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 typedef vec<3, float> vec3f;
@@ -265,4 +721,221 @@ typedef vec<2, int> vec2i;
 typedef vec<4, float> vec4f;
 typedef mat<4, 4, float> Matrix;
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Packets of 8 floats, one per lane, for the same math done on 8 vertices, pixels or rays at once. float8 stands in
+// for float and mask8 for bool, so vec<3, float8> and vec<4, float8> take the generic vec operators above, and code
+// written against select(), min(), max(), sqrt(), rsqrt(), any() and all() compiles for either width. Every lane gives
+// the same result as the scalar code except rsqrt, which is an estimate refined by one Newton step (about 22 bits).
+// One AVX register when compiled for AVX, two SSE ones otherwise, plain arrays without SSE.
+
+struct float8;
+
+struct mask8
+{
+	mask8() : mask8(false) {}
+	mask8(bool b);
+#if defined(GEOMETRY_AVX)
+	explicit mask8(const __m256 m) : m(m) {}
+	__m256 m;
+#elif defined(GEOMETRY_SSE)
+	mask8(const __m128 lo, const __m128 hi) : lo(lo), hi(hi) {}
+	__m128 lo, hi;
+#else
+	bool v[8];
+#endif
+	int bits() const; //lane i in bit i
+	bool operator[](const size_t i) const;
+};
+
+struct float8
+{
+	float8() : float8(0.f) {}
+	float8(float f);
+	static float8 load(const float* p); //no alignment needed
+	void store(float* p) const;
+#if defined(GEOMETRY_AVX)
+	explicit float8(const __m256 m) : m(m) {}
+	__m256 m;
+#elif defined(GEOMETRY_SSE)
+	float8(const __m128 lo, const __m128 hi) : lo(lo), hi(hi) {}
+	__m128 lo, hi;
+#else
+	float v[8];
+#endif
+	float operator[](const size_t i) const;
+	float8& operator+=(const float8& rhs);
+	float8& operator-=(const float8& rhs);
+	float8& operator*=(const float8& rhs);
+	float8& operator/=(const float8& rhs);
+};
+
+#if defined(GEOMETRY_AVX)
+inline mask8::mask8(bool b) : m(_mm256_castsi256_ps(_mm256_set1_epi32(b ? -1 : 0))) {}
+inline int mask8::bits() const { return _mm256_movemask_ps(m); }
+inline mask8 operator&(const mask8& lhs, const mask8& rhs) { return mask8(_mm256_and_ps(lhs.m, rhs.m)); }
+inline mask8 operator|(const mask8& lhs, const mask8& rhs) { return mask8(_mm256_or_ps(lhs.m, rhs.m)); }
+inline mask8 operator!(const mask8& m) { return mask8(_mm256_xor_ps(m.m, mask8(true).m)); }
+
+inline float8::float8(float f) : m(_mm256_set1_ps(f)) {}
+inline float8 float8::load(const float* p) { return float8(_mm256_loadu_ps(p)); }
+inline void float8::store(float* p) const { _mm256_storeu_ps(p, m); }
+inline float8 operator+(const float8& lhs, const float8& rhs) { return float8(_mm256_add_ps(lhs.m, rhs.m)); }
+inline float8 operator-(const float8& lhs, const float8& rhs) { return float8(_mm256_sub_ps(lhs.m, rhs.m)); }
+inline float8 operator*(const float8& lhs, const float8& rhs) { return float8(_mm256_mul_ps(lhs.m, rhs.m)); }
+inline float8 operator/(const float8& lhs, const float8& rhs) { return float8(_mm256_div_ps(lhs.m, rhs.m)); }
+inline float8 operator-(const float8& f) { return float8(_mm256_xor_ps(f.m, _mm256_set1_ps(-0.f))); }
+inline mask8 operator<(const float8& lhs, const float8& rhs) { return mask8(_mm256_cmp_ps(lhs.m, rhs.m, _CMP_LT_OQ)); }
+inline mask8 operator<=(const float8& lhs, const float8& rhs) { return mask8(_mm256_cmp_ps(lhs.m, rhs.m, _CMP_LE_OQ)); }
+inline mask8 operator>(const float8& lhs, const float8& rhs) { return mask8(_mm256_cmp_ps(lhs.m, rhs.m, _CMP_GT_OQ)); }
+inline mask8 operator>=(const float8& lhs, const float8& rhs) { return mask8(_mm256_cmp_ps(lhs.m, rhs.m, _CMP_GE_OQ)); }
+inline mask8 operator==(const float8& lhs, const float8& rhs) { return mask8(_mm256_cmp_ps(lhs.m, rhs.m, _CMP_EQ_OQ)); }
+inline mask8 operator!=(const float8& lhs, const float8& rhs) { return mask8(_mm256_cmp_ps(lhs.m, rhs.m, _CMP_NEQ_UQ)); }
+inline float8 select(const mask8& m, const float8& a, const float8& b) { return float8(_mm256_blendv_ps(b.m, a.m, m.m)); }
+inline float8 min(const float8& a, const float8& b) { return float8(_mm256_min_ps(a.m, b.m)); }
+inline float8 max(const float8& a, const float8& b) { return float8(_mm256_max_ps(a.m, b.m)); }
+inline float8 sqrt(const float8& f) { return float8(_mm256_sqrt_ps(f.m)); }
+inline float8 rsqrt_estimate(const float8& f) { return float8(_mm256_rsqrt_ps(f.m)); }
+#elif defined(GEOMETRY_SSE)
+inline mask8::mask8(bool b) : lo(_mm_cmpneq_ps(_mm_set1_ps(b), _mm_setzero_ps())), hi(lo) {}
+inline int mask8::bits() const { return _mm_movemask_ps(lo) | _mm_movemask_ps(hi) << 4; }
+inline mask8 operator&(const mask8& lhs, const mask8& rhs) { return mask8(_mm_and_ps(lhs.lo, rhs.lo), _mm_and_ps(lhs.hi, rhs.hi)); }
+inline mask8 operator|(const mask8& lhs, const mask8& rhs) { return mask8(_mm_or_ps(lhs.lo, rhs.lo), _mm_or_ps(lhs.hi, rhs.hi)); }
+inline mask8 operator!(const mask8& m) { return mask8(_mm_cmpeq_ps(m.lo, _mm_setzero_ps()), _mm_cmpeq_ps(m.hi, _mm_setzero_ps())); }
+
+inline float8::float8(float f) : lo(_mm_set1_ps(f)), hi(lo) {}
+inline float8 float8::load(const float* p) { return float8(_mm_loadu_ps(p), _mm_loadu_ps(p + 4)); }
+inline void float8::store(float* p) const { _mm_storeu_ps(p, lo); _mm_storeu_ps(p + 4, hi); }
+inline float8 operator+(const float8& lhs, const float8& rhs) { return float8(_mm_add_ps(lhs.lo, rhs.lo), _mm_add_ps(lhs.hi, rhs.hi)); }
+inline float8 operator-(const float8& lhs, const float8& rhs) { return float8(_mm_sub_ps(lhs.lo, rhs.lo), _mm_sub_ps(lhs.hi, rhs.hi)); }
+inline float8 operator*(const float8& lhs, const float8& rhs) { return float8(_mm_mul_ps(lhs.lo, rhs.lo), _mm_mul_ps(lhs.hi, rhs.hi)); }
+inline float8 operator/(const float8& lhs, const float8& rhs) { return float8(_mm_div_ps(lhs.lo, rhs.lo), _mm_div_ps(lhs.hi, rhs.hi)); }
+inline float8 operator-(const float8& f) { return float8(_mm_xor_ps(f.lo, _mm_set1_ps(-0.f)), _mm_xor_ps(f.hi, _mm_set1_ps(-0.f))); }
+inline mask8 operator<(const float8& lhs, const float8& rhs) { return mask8(_mm_cmplt_ps(lhs.lo, rhs.lo), _mm_cmplt_ps(lhs.hi, rhs.hi)); }
+inline mask8 operator<=(const float8& lhs, const float8& rhs) { return mask8(_mm_cmple_ps(lhs.lo, rhs.lo), _mm_cmple_ps(lhs.hi, rhs.hi)); }
+inline mask8 operator>(const float8& lhs, const float8& rhs) { return mask8(_mm_cmpgt_ps(lhs.lo, rhs.lo), _mm_cmpgt_ps(lhs.hi, rhs.hi)); }
+inline mask8 operator>=(const float8& lhs, const float8& rhs) { return mask8(_mm_cmpge_ps(lhs.lo, rhs.lo), _mm_cmpge_ps(lhs.hi, rhs.hi)); }
+inline mask8 operator==(const float8& lhs, const float8& rhs) { return mask8(_mm_cmpeq_ps(lhs.lo, rhs.lo), _mm_cmpeq_ps(lhs.hi, rhs.hi)); }
+inline mask8 operator!=(const float8& lhs, const float8& rhs) { return mask8(_mm_cmpneq_ps(lhs.lo, rhs.lo), _mm_cmpneq_ps(lhs.hi, rhs.hi)); }
+inline float8 select(const mask8& m, const float8& a, const float8& b)
+{
+	return float8(_mm_or_ps(_mm_and_ps(m.lo, a.lo), _mm_andnot_ps(m.lo, b.lo)), _mm_or_ps(_mm_and_ps(m.hi, a.hi), _mm_andnot_ps(m.hi, b.hi)));
+}
+inline float8 min(const float8& a, const float8& b) { return float8(_mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi)); }
+inline float8 max(const float8& a, const float8& b) { return float8(_mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi)); }
+inline float8 sqrt(const float8& f) { return float8(_mm_sqrt_ps(f.lo), _mm_sqrt_ps(f.hi)); }
+inline float8 rsqrt_estimate(const float8& f) { return float8(_mm_rsqrt_ps(f.lo), _mm_rsqrt_ps(f.hi)); }
+#else
+inline mask8::mask8(bool b) { for (size_t i = 0; i < 8; i++) v[i] = b; }
+inline int mask8::bits() const
+{
+	int ret = 0;
+	for (size_t i = 0; i < 8; i++) ret |= v[i] << i;
+	return ret;
+}
+inline mask8 operator&(mask8 lhs, const mask8& rhs) { for (size_t i = 0; i < 8; i++) lhs.v[i] = lhs.v[i] && rhs.v[i]; return lhs; }
+inline mask8 operator|(mask8 lhs, const mask8& rhs) { for (size_t i = 0; i < 8; i++) lhs.v[i] = lhs.v[i] || rhs.v[i]; return lhs; }
+inline mask8 operator!(mask8 m) { for (size_t i = 0; i < 8; i++) m.v[i] = !m.v[i]; return m; }
+
+inline float8::float8(float f) { for (size_t i = 0; i < 8; i++) v[i] = f; }
+inline float8 float8::load(const float* p) { float8 ret; for (size_t i = 0; i < 8; i++) ret.v[i] = p[i]; return ret; }
+inline void float8::store(float* p) const { for (size_t i = 0; i < 8; i++) p[i] = v[i]; }
+inline float8 operator+(float8 lhs, const float8& rhs) { for (size_t i = 0; i < 8; i++) lhs.v[i] += rhs.v[i]; return lhs; }
+inline float8 operator-(float8 lhs, const float8& rhs) { for (size_t i = 0; i < 8; i++) lhs.v[i] -= rhs.v[i]; return lhs; }
+inline float8 operator*(float8 lhs, const float8& rhs) { for (size_t i = 0; i < 8; i++) lhs.v[i] *= rhs.v[i]; return lhs; }
+inline float8 operator/(float8 lhs, const float8& rhs) { for (size_t i = 0; i < 8; i++) lhs.v[i] /= rhs.v[i]; return lhs; }
+inline float8 operator-(float8 f) { for (size_t i = 0; i < 8; i++) f.v[i] = -f.v[i]; return f; }
+inline mask8 operator<(const float8& lhs, const float8& rhs) { mask8 ret; for (size_t i = 0; i < 8; i++) ret.v[i] = lhs.v[i] < rhs.v[i]; return ret; }
+inline mask8 operator<=(const float8& lhs, const float8& rhs) { mask8 ret; for (size_t i = 0; i < 8; i++) ret.v[i] = lhs.v[i] <= rhs.v[i]; return ret; }
+inline mask8 operator>(const float8& lhs, const float8& rhs) { mask8 ret; for (size_t i = 0; i < 8; i++) ret.v[i] = lhs.v[i] > rhs.v[i]; return ret; }
+inline mask8 operator>=(const float8& lhs, const float8& rhs) { mask8 ret; for (size_t i = 0; i < 8; i++) ret.v[i] = lhs.v[i] >= rhs.v[i]; return ret; }
+inline mask8 operator==(const float8& lhs, const float8& rhs) { mask8 ret; for (size_t i = 0; i < 8; i++) ret.v[i] = lhs.v[i] == rhs.v[i]; return ret; }
+inline mask8 operator!=(const float8& lhs, const float8& rhs) { mask8 ret; for (size_t i = 0; i < 8; i++) ret.v[i] = lhs.v[i] != rhs.v[i]; return ret; }
+inline float8 select(const mask8& m, float8 a, const float8& b) { for (size_t i = 0; i < 8; i++) a.v[i] = m.v[i] ? a.v[i] : b.v[i]; return a; }
+inline float8 min(float8 a, const float8& b) { for (size_t i = 0; i < 8; i++) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+inline float8 max(float8 a, const float8& b) { for (size_t i = 0; i < 8; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+inline float8 sqrt(float8 f) { for (size_t i = 0; i < 8; i++) f.v[i] = std::sqrt(f.v[i]); return f; }
+inline float8 rsqrt_estimate(float8 f) { for (size_t i = 0; i < 8; i++) f.v[i] = 1.f / std::sqrt(f.v[i]); return f; }
+#endif
+
+#if defined(GEOMETRY_AVX) || defined(GEOMETRY_SSE)
+inline bool mask8::operator[](const size_t i) const { assert(i < 8); return bits() >> i & 1; }
+inline float float8::operator[](const size_t i) const
+{
+	assert(i < 8);
+	float lanes[8];
+	store(lanes);
+	return lanes[i];
+}
+#else
+inline bool mask8::operator[](const size_t i) const { assert(i < 8); return v[i]; }
+inline float float8::operator[](const size_t i) const { assert(i < 8); return v[i]; }
+#endif
+
+inline float8& float8::operator+=(const float8& rhs) { return *this = *this + rhs; }
+inline float8& float8::operator-=(const float8& rhs) { return *this = *this - rhs; }
+inline float8& float8::operator*=(const float8& rhs) { return *this = *this * rhs; }
+inline float8& float8::operator/=(const float8& rhs) { return *this = *this / rhs; }
+
+inline bool any(const mask8& m) { return m.bits() != 0; }
+inline bool all(const mask8& m) { return m.bits() == 0xff; }
+inline float8 abs(const float8& f) { return max(f, -f); }
+
+//one Newton step x * (1.5 - f/2 * x * x) on the hardware estimate
+inline float8 rsqrt(const float8& f)
+{
+	const float8 x = rsqrt_estimate(f);
+	return x * (float8(1.5f) - float8(.5f) * f * x * x);
+}
+
+//the scalar counterparts, for code instantiated on float
+inline float select(bool m, float a, float b) { return m ? a : b; }
+inline float rsqrt(float f) { return 1.f / std::sqrt(f); }
+inline bool any(bool m) { return m; }
+inline bool all(bool m) { return m; }
+
+template<size_t DIM, typename M, typename T> vec<DIM, T> select(const M& m, const vec<DIM, T>& a, vec<DIM, T> b)
+{
+	for (size_t i = DIM; i--; b[i] = select(m, a[i], b[i]));
+	return b;
+}
+
+template<size_t DIM, typename T> vec<DIM, T> normalize(const vec<DIM, T>& v)
+{
+	return v * rsqrt(v * v);
+}
+
+//a matrix applied to 8 vectors, summed in the order of the scalar dot product so each lane matches Matrix * vec4f
+template<size_t DimRows, size_t DimCols> vec<DimRows, float8> operator*(const mat<DimRows, DimCols, float>& lhs, const vec<DimCols, float8>& rhs)
+{
+	vec<DimRows, float8> ret;
+	for (size_t i = DimRows; i--;)
+	{
+		for (size_t j = DimCols; j--; ret[i] += float8(lhs[i][j]) * rhs[j]);
+	}
+	return ret;
+}
+
+//8 vectors from an array of them and back
+template<size_t DIM> vec<DIM, float8> pack(const vec<DIM, float>* v)
+{
+	vec<DIM, float8> ret;
+	for (size_t i = DIM; i--;)
+	{
+		float lanes[8];
+		for (size_t j = 8; j--; lanes[j] = v[j][i]);
+		ret[i] = float8::load(lanes);
+	}
+	return ret;
+}
+
+template<size_t DIM> vec<DIM, float> lane(const vec<DIM, float8>& v, const size_t i)
+{
+	vec<DIM, float> ret;
+	for (size_t j = DIM; j--; ret[j] = v[j][i]);
+	return ret;
+}
+
+typedef vec<3, float8> vec3x8;
+typedef vec<4, float8> vec4x8;
+
 #endif //_GEOMETRY_H
\ No newline at end of file
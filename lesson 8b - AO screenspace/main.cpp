@@ -2,16 +2,20 @@
 #include <cstdlib>
 #include <limits>
 #include <iostream>
+#include <filesystem>
 #include "../common/tgaimage.h"
+#include "../common/fastmath.h"
+#include "../common/thread_pool.h"
+#include "../common/frame_graph.h"
 #include "model.h"
 #include "geometry.h"
 #include "our_gl.h"
 
 #define M_PI       3.14159265358979323846   // pi
 Model* model = NULL;
-float* shadowbuffer = NULL;
 const int width = 800;
 const int height = 800;
+const std::uintmax_t stream_budget = 512 << 20; //bigger .obj files are rendered a chunk at a time
 
 
 vec3f eye(1.2, -0.8, 3);
@@ -40,68 +44,114 @@ struct ZShader : public IShader
 	}
 };
 
-float max_elevation_angle(float* zbuffer, vec2f p, vec2f dir)
+//marches all 8 directions at once, a lane leaves when its ray leaves the screen; atan is monotonic,
+//so the steepest slope of a lane gives its largest angle and atan is taken once per direction
+float8 max_elevation_angle(float* zbuffer, vec2f p, const vec<2, float8>& dir)
 {
-	float maxangle = 0;
-	for (float t = 0.; t < 1000.; t += 1.)
+	const vec<2, float8> origin(p.x, p.y);
+	const float depth = zbuffer[int(p.x) + int(p.y) * width];
+	float8 maxslope = 0;
+	mask8 marching = true;
+	for (float t = 0.; t < 1000. && any(marching); t += 1.)
 	{
-		vec2f cur = p + dir * t;
-		if (cur.x >= width || cur.y >= height || cur.x < 0 || cur.y < 0) return maxangle;
-
-		float distance = (p - cur).norm();
-		if (distance < 1.f) continue;
-		float elevation = zbuffer[int(cur.x) + int(cur.y) * width] - zbuffer[int(p.x) + int(p.y) * width];
-		maxangle = std::max(maxangle, atanf(elevation / distance));
+		vec<2, float8> cur = origin + dir * t;
+		marching = marching & (cur.x < width) & (cur.y < height) & (cur.x >= 0) & (cur.y >= 0);
+
+		vec<2, float8> delta = origin - cur;
+		float8 distance = sqrt(delta * delta);
+		mask8 sampled = marching & (distance >= 1.f);
+		if (!any(sampled)) continue;
+		float elevation[8] = {};
+		for (int i = 8; i--;)
+		{
+			if (sampled[i]) elevation[i] = zbuffer[int(cur.x[i]) + int(cur.y[i]) * width] - depth;
+		}
+		maxslope = select(sampled, max(maxslope, float8::load(elevation) / distance), maxslope);
 	}
 
-	return maxangle;
+	float angles[8];
+	for (int i = 8; i--; angles[i] = fast_atan<FAST_HIGH>(maxslope[i]));
+	return float8::load(angles);
 }
 
 
 int main()
 {
-	float* zbuffer = new float[width * height];
-	for (int i = width * height; i--;) { zbuffer[i] = -std::numeric_limits<float>::max(); }
-	model = new Model("../resources/diablo3_pose/diablo3_pose.obj");
+	const char* objfile = "../resources/diablo3_pose/diablo3_pose.obj";
+	std::error_code ec;
+	const bool streaming = std::filesystem::file_size(objfile, ec) > stream_budget && !ec;
+	std::future<Model*> loading; //the depth pass only needs the geometry, textures are left decoding
+	if (!streaming) loading = Model::load_async(objfile, Model::OPTIMIZE_MESH | Model::GENERATE_LODS);
+
+	float dirx[8], diry[8];
+	int ndirs = 0;
+	for (float a = 0; a < M_PI * 2 - 1e-4; a += M_PI / 4, ndirs++)
+	{
+		dirx[ndirs] = cos(a);
+		diry[ndirs] = sin(a);
+	}
+	const vec<2, float8> dirs(float8::load(dirx), float8::load(diry));
 
-	TGAImage frame(width, height, TGAImage::RGB);
-	lookat(eye, center, up);
-	viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
-	projection(-1.f / (eye - center).norm());
+	ThreadPool& pool = ThreadPool::shared();
+	FrameGraph graph(pool);
+	const FrameGraph::Resource zbuffer = graph.create_buffer("z buffer", width, height);
+	const FrameGraph::Resource zcolor = graph.create_image("z color", width, height, TGAImage::RGB);
+	const FrameGraph::Resource frame = graph.create_image("frame", width, height, TGAImage::RGB);
 
-	ZShader zshader;
-	for (int i = 0; i < model->nfaces(); i++)
+	graph.add_pass("z", {}, { zbuffer, zcolor }, [&]()
 	{
-		for (int j = 0; j < 3; j++)
+		lookat(eye, center, up);
+		viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
+		projection(-1.f / (eye - center).norm());
+
+		ZShader zshader;
+		if (streaming)
 		{
-			zshader.vertex(i, j);
+			ModelStream stream(objfile);
+			Model chunk;
+			model = &chunk;
+			while (stream.next(chunk)) draw(chunk, zshader, graph.image(zcolor), graph.buffer(zbuffer));
+			model = NULL;
 		}
+		else
+		{
+			pool.wait(loading);
+			model = loading.get();
+			//the AO marches the depth buffer across silhouettes, a pixel flipping there darkens its neighbours
+			model->set_lod(model->select_lod(screen_size(model->bbox_min(), model->bbox_max()), .5f));
+			draw(*model, zshader, graph.image(zcolor), graph.buffer(zbuffer));
+		}
+	});
 
-		triangle(zshader.varying_tri, zshader, frame, zbuffer);
-	}
-
-	for (int x = 0; x < width; x++)
+	graph.add_pass("ao", { zbuffer }, { frame }, [&]()
 	{
-		for (int y = 0; y < height; y++)
+		float* z = graph.buffer(zbuffer);
+		TGAImage& image = graph.image(frame);
+		pool.parallel_for(width, [&](const size_t x)
 		{
-			if (zbuffer[x + y * width] < -1e5) continue;
-			float total = 0;
-			for (float a = 0; a < M_PI * 2 - 1e-4; a += M_PI / 4)
+			for (int y = 0; y < height; y++)
 			{
-				total += M_PI / 2 - max_elevation_angle(zbuffer, vec2f(x, y), vec2f(cos(a), sin(a)));
+				if (z[x + y * width] < -1e5) continue;
+				float8 angles = max_elevation_angle(z, vec2f(x, y), dirs);
+				float total = 0;
+				for (int i = 0; i < 8; i++)
+				{
+					total += M_PI / 2 - angles[i];
+				}
+
+				total /= (M_PI / 2) * 8;
+				total = pow(total, 100.f);
+				image.set(x, y, TGAColor(total * 255, total * 255, total * 255));
 			}
+		});
+	});
 
-			total /= (M_PI / 2) * 8;
-			total = pow(total, 100.f);
-			frame.set(x, y, TGAColor(total * 255, total * 255, total * 255));
-		}
-	}
-
-	frame.write_tga_file("framebuffer2.tga");
+	graph.output(frame, "framebuffer2.tga");
+	graph.execute();
+	std::cerr << "# frame graph: " << graph.memory() / 1024 << " KiB of buffers, " << graph.unaliased_memory() / 1024 << " KiB without aliasing" << std::endl;
+	std::cerr << "# " << pool.size() << " workers, " << pool.steals() << " jobs stolen" << std::endl;
 
-	delete []zbuffer;
-	delete[]shadowbuffer;
 	delete model;
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -1,103 +1,1560 @@
 #include "model.h"
-#include <fstream>
-#include <sstream>
+#include <charconv>
+#include <chrono>
+#include <cstring>
 #include <cassert>
+#include <thread>
+#include <iterator>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <limits>
+#include <cmath>
+#include "../common/mapped_file.h"
 
+static const char* skip_blanks(const char* p, const char* end)
+{
+	while (p < end && (' ' == *p || '\t' == *p || '\r' == *p)) p++;
+	return p;
+}
 
+template<typename T> static bool parse_number(const char*& p, const char* end, T& value)
+{
+	p = skip_blanks(p, end);
+	if (p < end && '+' == *p) p++;
+	std::from_chars_result res = std::from_chars(p, end, value);
+	if (res.ec != std::errc()) return false;
+	p = res.ptr;
+	return true;
+}
 
-Model::Model(const char* filename) : verts_(), norms_(), uv_(), faces_(), diffusemap_(), normalmap_(), specularmap_()
+static bool starts_with(const char* p, const char* end, const char* prefix)
 {
-	assert(filename != 0);
-	std::ifstream in;
-	in.open(filename, std::ifstream::in);
-	assert(in);
-	std::string line;
-	char trash;
-	
-	while (!in.eof())
-	{
-		std::getline(in, line);
-		std::istringstream iss(line.c_str());
-		
-		if (!line.compare(0, 2, "v "))
-		{
-			iss >> trash;
+	size_t n = strlen(prefix);
+	return size_t(end - p) >= n && !memcmp(p, prefix, n);
+}
+
+//next v/vt/vn triplet of an f record, the indices as written: 1-based, or negative for relative ones
+static bool parse_triplet(const char*& p, const char* eol, vec3i& t)
+{
+	return parse_number(p, eol, t[0]) && p < eol && '/' == *p++ && parse_number(p, eol, t[1]) && p < eol && '/' == *p++ && parse_number(p, eol, t[2]);
+}
+
+//records of one piece of the file; relative (negative) face indices can only be resolved
+//once the number of v/vt/vn records of the previous pieces is known
+struct ObjChunk
+{
+	std::vector<vec3f> verts;
+	std::vector<vec3f> norms;
+	std::vector<vec2f> uv;
+	std::vector<vec3i> corners; //v/vt/vn of every face corner, faces back to back
+	std::vector<std::uint32_t> face_sizes;
+	std::vector<vec2i> fixups; //corner, attribute (0: v, 1: vt, 2: vn)
+};
+
+//parses the v, vt, vn and f records of [begin, end) without any stream or locale
+static void parse_obj_chunk(const char* begin, const char* end, ObjChunk& chunk)
+{
+	while (begin < end)
+	{
+		const char* eol = static_cast<const char*>(memchr(begin, '\n', end - begin));
+		if (!eol) eol = end;
+		const char* p = begin;
+		begin = eol + 1;
+
+		if (starts_with(p, eol, "v "))
+		{
+			p += 2;
 			vec3f v;
+			for (int i = 0; i < 3 && parse_number(p, eol, v[i]); i++);
+			chunk.verts.push_back(v);
+		}
+		else if (starts_with(p, eol, "vn "))
+		{
+			p += 3;
+			vec3f n;
+			for (int i = 0; i < 3 && parse_number(p, eol, n[i]); i++);
+			chunk.norms.push_back(n);
+		}
+		else if (starts_with(p, eol, "vt "))
+		{
+			p += 3;
+			vec2f t;
+			for (int i = 0; i < 2 && parse_number(p, eol, t[i]); i++);
+			chunk.uv.push_back(t);
+		}
+		else if (starts_with(p, eol, "f "))
+		{
+			p += 2;
+			std::uint32_t n = 0;
+			vec3i tmp;
+			const int counts[3] = { int(chunk.verts.size()), int(chunk.uv.size()), int(chunk.norms.size()) };
+			//v/vt/vn triplets only, like the stream based parser did
+			while (parse_triplet(p, eol, tmp))
+			{
+				//remember to correct the indices
+				for (int i = 0; i < 3; i++)
+				{
+					if (tmp[i] >= 0)
+					{
+						tmp[i]--;
+						continue;
+					}
+					tmp[i] += counts[i];
+					chunk.fixups.push_back(vec2i(int(chunk.corners.size()), i));
+				}
+				chunk.corners.push_back(tmp);
+				n++;
+			}
+
+			chunk.face_sizes.push_back(n);
+		}
+	}
+}
+
+//open addressing table from v/vt/vn triplets to vertex numbers, 0 is an empty slot
+class TripletTable
+{
+public:
+	//room for nkeys triplets before the table has to grow
+	void reset(const size_t nkeys)
+	{
+		size_t capacity = 16;
+		while (capacity < nkeys * 2) capacity *= 2;
+		slots_.assign(capacity, 0);
+		keys_.clear();
+	}
+
+	//number of the triplet, in order of first appearance; added tells whether it was new
+	std::uint32_t insert(const vec3i& key, bool& added)
+	{
+		if ((keys_.size() + 1) * 2 > slots_.size()) grow();
+		size_t slot = find(key);
+		added = !slots_[slot];
+		if (added)
+		{
+			keys_.push_back(key);
+			slots_[slot] = std::uint32_t(keys_.size());
+		}
+		return slots_[slot] - 1;
+	}
+
+	size_t size() const { return keys_.size(); }
+
+private:
+	std::vector<std::uint32_t> slots_;
+	std::vector<vec3i> keys_;
+
+	size_t find(const vec3i& key) const
+	{
+		const size_t mask = slots_.size() - 1;
+		std::uint64_t h = (std::uint64_t(std::uint32_t(key[0])) * 0x9E3779B97F4A7C15ull) ^ (std::uint64_t(std::uint32_t(key[1])) * 0xC2B2AE3D27D4EB4Full) ^ (std::uint64_t(std::uint32_t(key[2])) * 0x165667B19E3779F9ull);
+		size_t slot = size_t(h ^ (h >> 32)) & mask;
+		for (; slots_[slot]; slot = (slot + 1) & mask)
+		{
+			const vec3i& k = keys_[slots_[slot] - 1];
+			if (k[0] == key[0] && k[1] == key[1] && k[2] == key[2]) break;
+		}
+		return slot;
+	}
+
+	void grow()
+	{
+		slots_.assign(std::max<size_t>(16, slots_.size() * 2), 0);
+		for (size_t i = 0; i < keys_.size(); i++) slots_[find(keys_[i])] = std::uint32_t(i + 1);
+	}
+};
+
+//Splits the file at line boundaries, parses the pieces on the thread pool and appends them in order.
+void Model::parse_obj(const char* begin, const char* end)
+{
+	const size_t min_chunk = 1 << 20;
+	size_t nchunks = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), (end - begin) / min_chunk + 1);
+	std::vector<const char*> bounds(1, begin);
+	for (size_t i = 1; i < nchunks; i++)
+	{
+		const char* p = std::max(bounds.back(), begin + (end - begin) * i / nchunks);
+		const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+		if (eol && eol + 1 < end) bounds.push_back(eol + 1);
+	}
+	bounds.push_back(end);
+
+	std::vector<ObjChunk> chunks(bounds.size() - 1);
+	ThreadPool::shared().parallel_for(chunks.size(), [&](size_t i) { parse_obj_chunk(bounds[i], bounds[i + 1], chunks[i]); });
+
+	size_t nverts = 0, nuv = 0, nnorms = 0, ncorners = 0, ntris = 0;
+	for (const ObjChunk& c : chunks)
+	{
+		nverts += c.verts.size();
+		nuv += c.uv.size();
+		nnorms += c.norms.size();
+		ncorners += c.corners.size();
+		for (std::uint32_t n : c.face_sizes) ntris += n > 2 ? n - 2 : 0;
+	}
+	std::vector<vec3f> verts, norms;
+	std::vector<vec2f> uv;
+	verts.reserve(nverts);
+	uv.reserve(nuv);
+	norms.reserve(nnorms);
+	for (ObjChunk& c : chunks)
+	{
+		const int offsets[3] = { int(verts.size()), int(uv.size()), int(norms.size()) };
+		for (const vec2i& fix : c.fixups) c.corners[fix[0]][fix[1]] += offsets[fix[1]];
+		verts.insert(verts.end(), c.verts.begin(), c.verts.end());
+		uv.insert(uv.end(), c.uv.begin(), c.uv.end());
+		norms.insert(norms.end(), c.norms.begin(), c.norms.end());
+	}
+	for (vec3f& n : norms) n.normalize();
+
+	TripletTable table;
+	table.reset(ncorners);
+	size_t nkeys = std::min(ncorners, nverts + nuv + nnorms);
+	verts_.reserve(nkeys);
+	uv_.reserve(nkeys);
+	norms_.reserve(nkeys);
+	auto vertex = [&](const vec3i& key) -> std::uint32_t
+	{
+		bool added;
+		std::uint32_t index = table.insert(key, added);
+		if (added)
+		{
+			//a record the file does not have reads as zero
+			verts_.push_back(size_t(key[0]) < verts.size() ? verts[key[0]] : vec3f());
+			uv_.push_back(size_t(key[1]) < uv.size() ? uv[key[1]] : vec2f());
+			norms_.push_back(size_t(key[2]) < norms.size() ? norms[key[2]] : vec3f());
+		}
+		return index;
+	};
+
+	indices_.reserve(ntris * 3);
+	for (const ObjChunk& c : chunks)
+	{
+		const vec3i* corner = c.corners.data();
+		for (std::uint32_t n : c.face_sizes)
+		{
+			if (n >= 3)
+			{
+				std::uint32_t first = vertex(corner[0]);
+				std::uint32_t prev = vertex(corner[1]);
+				for (std::uint32_t i = 2; i < n; i++)
+				{
+					std::uint32_t cur = vertex(corner[i]);
+					indices_.push_back(first);
+					indices_.push_back(prev);
+					indices_.push_back(cur);
+					prev = cur;
+				}
+			}
+			corner += n;
+		}
+	}
+}
+
+//FIFO post-transform cache model shared by the reordering passes, as in the Tipsify paper
+static const std::uint32_t vertex_cache_size = 16;
+
+//a vertex is cached when it was inserted less than vertex_cache_size insertions ago
+static int cache_misses(const std::uint32_t* tri, std::vector<std::uint32_t>& timestamps, std::uint32_t& time)
+{
+	int misses = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		if (time - timestamps[tri[i]] <= vertex_cache_size) continue;
+		timestamps[tri[i]] = time++;
+		misses++;
+	}
+	return misses;
+}
+
+//average cache miss ratio: transformed vertices per triangle, 0.5 at best for a big regular mesh and 3 at worst
+static float acmr(const std::vector<std::uint32_t>& indices, const size_t nverts)
+{
+	if (indices.empty()) return 0;
+	std::vector<std::uint32_t> timestamps(nverts, 0);
+	std::uint32_t time = vertex_cache_size + 1;
+	size_t misses = 0;
+	for (size_t i = 0; i < indices.size(); i += 3) misses += cache_misses(&indices[i], timestamps, time);
+	return float(misses) / float(indices.size() / 3);
+}
+
+//Sander, Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007.
+//Emits all the triangles around a fanning vertex, then moves on to the neighbour that will still be
+//in the cache after its own fan is emitted, falling back to recently used vertices and then to a scan.
+static std::vector<std::uint32_t> tipsify(const std::vector<std::uint32_t>& indices, const size_t nverts)
+{
+	const size_t ntris = indices.size() / 3;
+	std::vector<std::uint32_t> live(nverts, 0);
+	for (std::uint32_t v : indices) live[v]++;
+	std::vector<std::uint32_t> offsets(nverts + 1, 0);
+	for (size_t v = 0; v < nverts; v++) offsets[v + 1] = offsets[v] + live[v];
+	std::vector<std::uint32_t> adjacency(indices.size());
+	std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++) adjacency[fill[indices[i]]++] = std::uint32_t(i / 3);
+
+	std::vector<std::uint32_t> timestamps(nverts, 0);
+	std::uint32_t time = vertex_cache_size + 1;
+	std::vector<bool> emitted(ntris, false);
+	std::vector<std::uint32_t> deadend;
+	std::vector<std::uint32_t> candidates;
+	std::vector<std::uint32_t> result;
+	result.reserve(indices.size());
+	size_t cursor = 0;
+	long long fan = ntris ? indices[0] : -1;
+	while (fan >= 0)
+	{
+		candidates.clear();
+		for (std::uint32_t k = offsets[fan]; k < offsets[fan + 1]; k++)
+		{
+			std::uint32_t t = adjacency[k];
+			if (emitted[t]) continue;
+			emitted[t] = true;
+			for (int j = 0; j < 3; j++)
+			{
+				std::uint32_t v = indices[t * 3 + j];
+				result.push_back(v);
+				deadend.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - timestamps[v] > vertex_cache_size) timestamps[v] = time++;
+			}
+		}
+
+		fan = -1;
+		long long best = -1;
+		for (std::uint32_t v : candidates)
+		{
+			if (!live[v]) continue;
+			long long age = time - timestamps[v];
+			long long priority = age + 2 * live[v] <= vertex_cache_size ? age : 0;
+			if (priority > best)
+			{
+				best = priority;
+				fan = v;
+			}
+		}
+		while (fan < 0 && !deadend.empty())
+		{
+			std::uint32_t v = deadend.back();
+			deadend.pop_back();
+			if (live[v]) fan = v;
+		}
+		if (fan < 0)
+		{
+			while (cursor < nverts && !live[cursor]) cursor++;
+			if (cursor < nverts) fan = cursor;
+		}
+	}
+	return result;
+}
+
+//Splits the cache ordered triangles into clusters and draws the clusters that face away from the
+//centre of the mesh first: they tend to occlude the rest from any viewpoint, so early-z rejects more
+//fragments. A cluster ends where the cache starts over (a triangle with three misses), or earlier where
+//cutting costs at most threshold times the cluster's own ACMR.
+static void sort_clusters(std::vector<std::uint32_t>& indices, const huge_vector<vec3f>& verts, const float threshold)
+{
+	const size_t ntris = indices.size() / 3;
+	std::vector<std::uint32_t> timestamps(verts.size(), 0);
+	std::uint32_t time = vertex_cache_size + 1;
+	std::vector<size_t> hard(1, 0);
+	for (size_t t = 0; t < ntris; t++)
+	{
+		if (cache_misses(&indices[t * 3], timestamps, time) == 3 && t > 0) hard.push_back(t);
+	}
+	hard.push_back(ntris);
+
+	std::vector<size_t> clusters;
+	for (size_t c = 0; c + 1 < hard.size(); c++)
+	{
+		size_t misses = 0;
+		time += vertex_cache_size + 1;
+		for (size_t t = hard[c]; t < hard[c + 1]; t++) misses += cache_misses(&indices[t * 3], timestamps, time);
+		const float limit = threshold * misses / float(hard[c + 1] - hard[c]);
+
+		clusters.push_back(hard[c]);
+		time += vertex_cache_size + 1;
+		size_t running_misses = 0, running_tris = 0;
+		for (size_t t = hard[c]; t < hard[c + 1]; t++)
+		{
+			running_misses += cache_misses(&indices[t * 3], timestamps, time);
+			running_tris++;
+			if (t + 1 < hard[c + 1] && running_misses <= limit * running_tris)
+			{
+				clusters.push_back(t + 1);
+				time += vertex_cache_size + 1;
+				running_misses = running_tris = 0;
+			}
+		}
+	}
+	clusters.push_back(ntris);
+
+	vec3f center(0, 0, 0);
+	float area = 0;
+	std::vector<vec3f> centroids(clusters.size() - 1), normals(clusters.size() - 1);
+	for (size_t c = 0; c + 1 < clusters.size(); c++)
+	{
+		vec3f centroid(0, 0, 0), normal(0, 0, 0);
+		float cluster_area = 0;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+		{
+			const vec3f& a = verts[indices[t * 3]];
+			const vec3f& b = verts[indices[t * 3 + 1]];
+			const vec3f& d = verts[indices[t * 3 + 2]];
+			vec3f n = cross(b - a, d - a);
+			float w = n.norm();
+			centroid = centroid + (a + b + d) * (w / 3.f);
+			normal = normal + n;
+			cluster_area += w;
+		}
+		center = center + centroid;
+		area += cluster_area;
+		centroids[c] = cluster_area > 0 ? centroid / cluster_area : verts[indices[clusters[c] * 3]];
+		normals[c] = normal;
+	}
+	if (area > 0) center = center / area;
+
+	std::vector<float> keys(clusters.size() - 1);
+	for (size_t c = 0; c < keys.size(); c++)
+	{
+		float l = normals[c].norm();
+		keys[c] = l > 0 ? (centroids[c] - center) * normals[c] / l : 0;
+	}
+	std::vector<std::uint32_t> order(keys.size());
+	for (size_t c = 0; c < order.size(); c++) order[c] = std::uint32_t(c);
+	std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) { return keys[a] > keys[b]; });
+
+	std::vector<std::uint32_t> result;
+	result.reserve(indices.size());
+	for (std::uint32_t c : order)
+	{
+		result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	}
+	indices.swap(result);
+}
+
+void Model::optimize_mesh()
+{
+	auto start = std::chrono::steady_clock::now();
+	float before = acmr(indices_, verts_.size());
+	indices_ = tipsify(indices_, verts_.size());
+	float tipsified = acmr(indices_, verts_.size());
+	sort_clusters(indices_, verts_, 1.05f);
+	for (std::vector<std::uint32_t>& lod : lods_)
+	{
+		lod = tipsify(lod, verts_.size());
+		sort_clusters(lod, verts_, 1.05f);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << "# ACMR " << before << " -> " << tipsified << " (vertex cache) -> " << acmr(indices_, verts_.size()) << " (overdraw order) in " << seconds * 1e3 << " ms" << std::endl;
+	optimized_ = true;
+}
+
+//symmetric 4x4 error quadric of a set of planes, weighted by triangle area; evaluate() is the
+//weighted sum of squared distances from p to the planes
+struct Quadric
+{
+	double a[10]; //xx xy xz xw yy yz yw zz zw ww
+	double weight;
+
+	Quadric() : a(), weight(0) {}
+	Quadric(const vec3f& n, const float d, const double w) : weight(w)
+	{
+		const double p[4] = { n.x, n.y, n.z, d };
+		for (int i = 0, k = 0; i < 4; i++)
+			for (int j = i; j < 4; j++) a[k++] = p[i] * p[j] * w;
+	}
+	Quadric& operator+=(const Quadric& q)
+	{
+		for (int i = 0; i < 10; i++) a[i] += q.a[i];
+		weight += q.weight;
+		return *this;
+	}
+	double evaluate(const vec3f& p) const
+	{
+		const double x = p.x, y = p.y, z = p.z;
+		double e = a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+			+ a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+			+ a[7] * z * z + 2 * a[8] * z + a[9];
+		return std::max(e, 0.);
+	}
+};
+
+//how a vertex may move during simplification
+enum VertexKind
+{
+	VERTEX_MANIFOLD, //inside a surface, collapses anywhere
+	VERTEX_BORDER,   //on an open border, only slides along it
+	VERTEX_SEAM,     //one of two copies on a uv or normal seam, both copies slide along the seam together
+	VERTEX_LOCKED    //anything else: corners, poles, non manifold spots
+};
+
+static const std::uint32_t no_edge = ~0u;
+static const std::uint32_t many_edges = ~1u;
+
+//Quadric edge collapse (Garland, Heckbert 1997) restricted to half-edges, so that the LODs only
+//index the vertices of the full mesh. Collapses run in passes: every pass rebuilds the adjacency,
+//takes the cheapest independent collapses until it has removed its share of triangles, and rejects
+//those that would flip a triangle, pinch the surface or fold a normal by more than 60 degrees.
+class Simplifier
+{
+public:
+	Simplifier(const huge_vector<vec3f>& verts, const huge_vector<vec3f>& norms, const std::vector<std::uint32_t>& indices);
+	//collapses edges of the current mesh until it has at most target triangles or nothing collapses
+	void simplify(const size_t target);
+	const std::vector<std::uint32_t>& indices() const { return indices_; }
+private:
+	const huge_vector<vec3f>& verts_;
+	const huge_vector<vec3f>& norms_;
+	std::vector<std::uint32_t> indices_;
+	std::vector<std::uint32_t> wedge_; //circular list of the vertices sharing a position
+	std::vector<Quadric> quadrics_;
+	std::vector<std::uint32_t> offsets_, adjacency_; //triangles around each vertex
+	std::vector<std::uint32_t> open_out_, open_in_;
+	std::vector<std::uint8_t> kind_;
+	std::vector<std::uint32_t> stamp_;
+	std::uint32_t time_;
+
+	void build_adjacency();
+	void classify();
+	bool has_edge(const std::uint32_t a, const std::uint32_t b) const;
+	bool can_collapse(const std::uint32_t u, const std::uint32_t v) const;
+	std::uint32_t seam_target(const std::uint32_t u, const std::uint32_t v) const;
+	double cost(const std::uint32_t u, const std::uint32_t v) const;
+	bool valid_collapse(const std::uint32_t u, const std::uint32_t v);
+};
+
+Simplifier::Simplifier(const huge_vector<vec3f>& verts, const huge_vector<vec3f>& norms, const std::vector<std::uint32_t>& indices) :
+	verts_(verts), norms_(norms), indices_(indices), wedge_(verts.size()), quadrics_(verts.size()), stamp_(verts.size(), 0), time_(0)
+{
+	const size_t nverts = verts.size();
+	std::vector<std::uint32_t> order(nverts);
+	for (size_t i = 0; i < nverts; i++) order[i] = std::uint32_t(i);
+	auto less = [&](std::uint32_t a, std::uint32_t b)
+	{
+		const vec3f& p = verts[a];
+		const vec3f& q = verts[b];
+		return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+	};
+	std::sort(order.begin(), order.end(), less);
+	for (size_t i = 0; i < nverts;)
+	{
+		size_t j = i + 1;
+		while (j < nverts && !less(order[i], order[j])) j++;
+		for (size_t k = i; k < j; k++) wedge_[order[k]] = order[k + 1 < j ? k + 1 : i];
+		i = j;
+	}
+
+	for (size_t t = 0; t + 2 < indices_.size(); t += 3)
+	{
+		const vec3f& a = verts[indices_[t]];
+		vec3f n = cross(verts[indices_[t + 1]] - a, verts[indices_[t + 2]] - a);
+		float area = n.norm();
+		if (area <= 0) continue;
+		n = n / area;
+		Quadric q(n, -(n * a), area);
+		for (int i = 0; i < 3; i++) quadrics_[indices_[t + i]] += q;
+	}
+
+	//open edges keep their place: a plane through the edge, perpendicular to its triangle
+	build_adjacency();
+	for (size_t t = 0; t + 2 < indices_.size(); t += 3)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			std::uint32_t a = indices_[t + i], b = indices_[t + (i + 1) % 3];
+			if (has_edge(b, a)) continue;
+			const vec3f& p = verts[a];
+			vec3f edge = verts[b] - p;
+			vec3f n = cross(edge, cross(verts[indices_[t + 1]] - verts[indices_[t]], verts[indices_[t + 2]] - verts[indices_[t]]));
+			float l = n.norm();
+			if (l <= 0) continue;
+			n = n / l;
+			Quadric q(n, -(n * p), edge * edge * 10.);
+			quadrics_[a] += q;
+			quadrics_[b] += q;
+		}
+	}
+}
+
+void Simplifier::build_adjacency()
+{
+	offsets_.assign(verts_.size() + 1, 0);
+	for (std::uint32_t v : indices_) offsets_[v + 1]++;
+	for (size_t v = 0; v < verts_.size(); v++) offsets_[v + 1] += offsets_[v];
+	adjacency_.resize(indices_.size());
+	std::vector<std::uint32_t> fill(offsets_.begin(), offsets_.end() - 1);
+	for (size_t i = 0; i < indices_.size(); i++) adjacency_[fill[indices_[i]]++] = std::uint32_t(i / 3);
+}
+
+//is there a triangle with the directed edge a->b
+bool Simplifier::has_edge(const std::uint32_t a, const std::uint32_t b) const
+{
+	for (std::uint32_t k = offsets_[a]; k < offsets_[a + 1]; k++)
+	{
+		const std::uint32_t* tri = &indices_[adjacency_[k] * 3];
+		for (int i = 0; i < 3; i++)
+			if (tri[i] == a && tri[(i + 1) % 3] == b) return true;
+	}
+	return false;
+}
+
+void Simplifier::classify()
+{
+	const size_t nverts = verts_.size();
+	open_out_.assign(nverts, no_edge);
+	open_in_.assign(nverts, no_edge);
+	for (size_t t = 0; t < indices_.size(); t += 3)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			std::uint32_t a = indices_[t + i], b = indices_[t + (i + 1) % 3];
+			if (has_edge(b, a)) continue;
+			open_out_[a] = open_out_[a] == no_edge ? b : many_edges;
+			open_in_[b] = open_in_[b] == no_edge ? a : many_edges;
+		}
+	}
+
+	kind_.assign(nverts, VERTEX_LOCKED);
+	for (size_t v = 0; v < nverts; v++)
+	{
+		if (offsets_[v] == offsets_[v + 1]) continue;
+		std::uint32_t copies = 0, mate = std::uint32_t(v);
+		for (std::uint32_t w = wedge_[v]; w != v; w = wedge_[w])
+		{
+			if (offsets_[w] == offsets_[w + 1]) continue;
+			copies++;
+			mate = w;
+		}
+		bool open = open_out_[v] != no_edge || open_in_[v] != no_edge;
+		bool simple = open_out_[v] < many_edges && open_in_[v] < many_edges;
+		if (!copies)
+		{
+			kind_[v] = !open ? VERTEX_MANIFOLD : simple ? VERTEX_BORDER : VERTEX_LOCKED;
+		}
+		else if (copies == 1 && simple && open_out_[mate] < many_edges && open_in_[mate] < many_edges)
+		{
+			//the two sides of a seam run in opposite directions
+			const vec3f& a = verts_[open_in_[v]];
+			const vec3f& b = verts_[open_out_[mate]];
+			const vec3f& c = verts_[open_out_[v]];
+			const vec3f& d = verts_[open_in_[mate]];
+			if (a.x == b.x && a.y == b.y && a.z == b.z && c.x == d.x && c.y == d.y && c.z == d.z) kind_[v] = VERTEX_SEAM;
+		}
+	}
+}
+
+bool Simplifier::can_collapse(const std::uint32_t u, const std::uint32_t v) const
+{
+	switch (kind_[u])
+	{
+	case VERTEX_MANIFOLD:
+		return true;
+	case VERTEX_BORDER:
+	case VERTEX_SEAM:
+		return (kind_[v] == kind_[u] || kind_[v] == VERTEX_LOCKED) && (open_out_[u] == v || open_in_[u] == v);
+	default:
+		return false;
+	}
+}
+
+//the copy of v that the other copy of seam vertex u collapses to
+std::uint32_t Simplifier::seam_target(const std::uint32_t u, const std::uint32_t v) const
+{
+	std::uint32_t mate = wedge_[u];
+	while (offsets_[mate] == offsets_[mate + 1]) mate = wedge_[mate];
+	std::uint32_t target = open_out_[u] == v ? open_in_[mate] : open_out_[mate];
+	const vec3f& p = verts_[v];
+	const vec3f& q = verts_[target];
+	return p.x == q.x && p.y == q.y && p.z == q.z ? target : no_edge;
+}
+
+double Simplifier::cost(const std::uint32_t u, const std::uint32_t v) const
+{
+	double e = quadrics_[u].evaluate(verts_[v]);
+	double w = quadrics_[u].weight;
+	if (kind_[u] == VERTEX_SEAM)
+	{
+		std::uint32_t mate = wedge_[u];
+		while (offsets_[mate] == offsets_[mate + 1]) mate = wedge_[mate];
+		e += quadrics_[mate].evaluate(verts_[v]);
+		w += quadrics_[mate].weight;
+	}
+	return w > 0 ? e / w : 0;
+}
+
+//u moving onto v must not flip or squash a triangle, pinch the surface or bend the normal too far
+bool Simplifier::valid_collapse(const std::uint32_t u, const std::uint32_t v)
+{
+	if (norms_[u] * norms_[v] < .5f) return false;
+
+	time_++;
+	int shared = 0;
+	for (std::uint32_t k = offsets_[v]; k < offsets_[v + 1]; k++)
+	{
+		const std::uint32_t* tri = &indices_[adjacency_[k] * 3];
+		for (int i = 0; i < 3; i++) stamp_[tri[i]] = time_;
+	}
+	for (std::uint32_t k = offsets_[u]; k < offsets_[u + 1]; k++)
+	{
+		const std::uint32_t* tri = &indices_[adjacency_[k] * 3];
+		if (tri[0] == v || tri[1] == v || tri[2] == v)
+		{
+			shared++;
+			continue;
+		}
+		int i = tri[0] == u ? 0 : tri[1] == u ? 1 : 2;
+		const vec3f& b = verts_[tri[(i + 1) % 3]];
+		const vec3f& c = verts_[tri[(i + 2) % 3]];
+		vec3f before = cross(b - verts_[u], c - verts_[u]);
+		vec3f after = cross(b - verts_[v], c - verts_[v]);
+		if (before * after < .25f * before.norm() * after.norm() || after * after == 0) return false;
+	}
+	if (!shared) return false;
+
+	//the only vertices of both rings must be the opposite corners of the collapsed triangles
+	int common = 0;
+	for (std::uint32_t k = offsets_[u]; k < offsets_[u + 1]; k++)
+	{
+		const std::uint32_t* tri = &indices_[adjacency_[k] * 3];
+		for (int i = 0; i < 3; i++)
+		{
+			std::uint32_t w = tri[i];
+			if (w == u || w == v || stamp_[w] != time_) continue;
+			stamp_[w] = 0;
+			common++;
+		}
+	}
+	return common <= shared;
+}
+
+void Simplifier::simplify(const size_t target)
+{
+	struct Collapse
+	{
+		double cost;
+		std::uint32_t u, v;
+	};
+	std::vector<Collapse> collapses;
+	std::vector<std::uint32_t> remap(verts_.size());
+	std::vector<bool> touched(verts_.size());
+
+	while (indices_.size() / 3 > target)
+	{
+		build_adjacency();
+		classify();
+
+		collapses.clear();
+		for (size_t t = 0; t < indices_.size(); t += 3)
+		{
 			for (int i = 0; i < 3; i++)
 			{
-				iss >> v[i];
+				std::uint32_t a = indices_[t + i], b = indices_[t + (i + 1) % 3];
+				if (a > b && has_edge(b, a)) continue; //the other triangle of the edge deals with it
+				double ab = can_collapse(a, b) && (kind_[a] != VERTEX_SEAM || seam_target(a, b) != no_edge) ? cost(a, b) : -1;
+				double ba = can_collapse(b, a) && (kind_[b] != VERTEX_SEAM || seam_target(b, a) != no_edge) ? cost(b, a) : -1;
+				if (ab >= 0 && (ba < 0 || ab <= ba)) collapses.push_back({ ab, a, b });
+				else if (ba >= 0) collapses.push_back({ ba, b, a });
 			}
-			verts_.push_back(v);
 		}
-		else if (!line.compare(0, 3, "vn "))
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		for (size_t v = 0; v < remap.size(); v++) remap[v] = std::uint32_t(v);
+		std::fill(touched.begin(), touched.end(), false);
+		const size_t goal = indices_.size() / 3 - target;
+		size_t removed = 0;
+		for (const Collapse& c : collapses)
 		{
-			iss >> trash >> trash;
-			vec3f n;
+			if (removed >= goal) break;
+			std::uint32_t pair[2][2] = { { c.u, c.v }, { no_edge, no_edge } };
+			if (kind_[c.u] == VERTEX_SEAM)
+			{
+				pair[1][0] = wedge_[c.u];
+				while (offsets_[pair[1][0]] == offsets_[pair[1][0] + 1]) pair[1][0] = wedge_[pair[1][0]];
+				pair[1][1] = seam_target(c.u, c.v);
+			}
+			int n = pair[1][0] == no_edge ? 1 : 2;
+			bool ok = true;
+			for (int i = 0; i < n && ok; i++)
+			{
+				ok = !touched[pair[i][0]] && !touched[pair[i][1]] && valid_collapse(pair[i][0], pair[i][1]);
+			}
+			if (!ok) continue;
+
+			for (int i = 0; i < n; i++)
+			{
+				std::uint32_t u = pair[i][0], v = pair[i][1];
+				remap[u] = v;
+				quadrics_[v] += quadrics_[u];
+				for (std::uint32_t k = offsets_[u]; k < offsets_[u + 1]; k++)
+				{
+					const std::uint32_t* tri = &indices_[adjacency_[k] * 3];
+					for (int j = 0; j < 3; j++) touched[tri[j]] = true;
+					removed += tri[0] == v || tri[1] == v || tri[2] == v;
+				}
+			}
+		}
+		if (!removed) break;
+
+		size_t kept = 0;
+		for (size_t t = 0; t < indices_.size(); t += 3)
+		{
+			std::uint32_t a = remap[indices_[t]], b = remap[indices_[t + 1]], c = remap[indices_[t + 2]];
+			if (a == b || b == c || c == a) continue;
+			indices_[kept++] = a;
+			indices_[kept++] = b;
+			indices_[kept++] = c;
+		}
+		indices_.resize(kept);
+	}
+}
+
+//closest point to p on the triangle abc (Ericson, Real-Time Collision Detection, 5.1.5)
+static vec3f closest_on_triangle(const vec3f& p, const vec3f& a, const vec3f& b, const vec3f& c)
+{
+	vec3f ab = b - a, ac = c - a, ap = p - a;
+	float d1 = ab * ap, d2 = ac * ap;
+	if (d1 <= 0 && d2 <= 0) return a;
+	vec3f bp = p - b;
+	float d3 = ab * bp, d4 = ac * bp;
+	if (d3 >= 0 && d4 <= d3) return b;
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
+	vec3f cp = p - c;
+	float d5 = ab * cp, d6 = ac * cp;
+	if (d6 >= 0 && d5 <= d6) return c;
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	float denom = 1 / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+//uniform grid over the triangles of a mesh, every triangle listed in the cells its bounding box touches;
+//distance() searches the cells in growing shells around p until nothing farther out can be closer
+class TriangleGrid
+{
+public:
+	TriangleGrid(const huge_vector<vec3f>& verts, const std::vector<std::uint32_t>& indices, const vec3f& bmin, const vec3f& bmax);
+	float distance(const vec3f& p) const;
+private:
+	const huge_vector<vec3f>& verts_;
+	const std::vector<std::uint32_t>& indices_;
+	vec3f origin_;
+	float cell_;
+	int res_[3];
+	std::vector<std::uint32_t> offsets_, triangles_;
+
+	int cell(const vec3f& p, const int axis) const { return std::max(0, std::min(res_[axis] - 1, int((p[axis] - origin_[axis]) / cell_))); }
+};
+
+TriangleGrid::TriangleGrid(const huge_vector<vec3f>& verts, const std::vector<std::uint32_t>& indices, const vec3f& bmin, const vec3f& bmax) :
+	verts_(verts), indices_(indices), origin_(bmin), cell_(1), res_{ 1, 1, 1 }
+{
+	//cells twice the average edge, a few triangles each, at most 256 of them along the longest side
+	const size_t ntris = indices.size() / 3;
+	double edges = 0;
+	for (size_t t = 0; t < ntris; t++)
+		for (int i = 0; i < 3; i++) edges += (verts[indices[t * 3 + (i + 1) % 3]] - verts[indices[t * 3 + i]]).norm();
+	vec3f extent = bmax - bmin;
+	float size = std::max(extent.x, std::max(extent.y, extent.z));
+	if (size > 0) cell_ = std::max(ntris ? float(2 * edges / (3 * ntris)) : size, size / 256);
+	for (int i = 0; i < 3; i++) res_[i] = std::max(1, int(std::ceil(extent[i] / cell_)));
+
+	auto cells = [&](size_t t, int lo[3], int hi[3])
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			lo[i] = res_[i];
+			hi[i] = 0;
+			for (int j = 0; j < 3; j++)
+			{
+				int c = cell(verts[indices[t * 3 + j]], i);
+				lo[i] = std::min(lo[i], c);
+				hi[i] = std::max(hi[i], c);
+			}
+		}
+	};
+	offsets_.assign(size_t(res_[0]) * res_[1] * res_[2] + 1, 0);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		std::vector<std::uint32_t> fill(offsets_.begin(), offsets_.end() - 1);
+		for (size_t t = 0; t < ntris; t++)
+		{
+			int lo[3], hi[3];
+			cells(t, lo, hi);
+			for (int z = lo[2]; z <= hi[2]; z++)
+				for (int y = lo[1]; y <= hi[1]; y++)
+					for (int x = lo[0]; x <= hi[0]; x++)
+					{
+						size_t c = (size_t(z) * res_[1] + y) * res_[0] + x;
+						if (pass) triangles_[fill[c]++] = std::uint32_t(t);
+						else offsets_[c + 1]++;
+					}
+		}
+		if (pass) break;
+		for (size_t c = 0; c + 1 < offsets_.size(); c++) offsets_[c + 1] += offsets_[c];
+		triangles_.resize(offsets_.back());
+	}
+}
+
+float TriangleGrid::distance(const vec3f& p) const
+{
+	const int center[3] = { cell(p, 0), cell(p, 1), cell(p, 2) };
+	const int maxr = std::max(res_[0], std::max(res_[1], res_[2]));
+	float best = std::numeric_limits<float>::max();
+	for (int r = 0; r <= maxr; r++)
+	{
+		int lo[3], hi[3];
+		for (int i = 0; i < 3; i++)
+		{
+			lo[i] = std::max(0, center[i] - r);
+			hi[i] = std::min(res_[i] - 1, center[i] + r);
+		}
+		for (int z = lo[2]; z <= hi[2]; z++)
+			for (int y = lo[1]; y <= hi[1]; y++)
+				for (int x = lo[0]; x <= hi[0]; x++)
+				{
+					//the shell only, the inside was searched before, and only cells that can hold something closer
+					if (std::abs(x - center[0]) != r && std::abs(y - center[1]) != r && std::abs(z - center[2]) != r) continue;
+					const int xyz[3] = { x, y, z };
+					float gap = 0;
+					for (int i = 0; i < 3; i++)
+					{
+						float lo = origin_[i] + xyz[i] * cell_;
+						float d = std::max(0.f, std::max(lo - p[i], p[i] - lo - cell_));
+						gap += d * d;
+					}
+					if (gap >= best) continue;
+					size_t c = (size_t(z) * res_[1] + y) * res_[0] + x;
+					for (std::uint32_t k = offsets_[c]; k < offsets_[c + 1]; k++)
+					{
+						const std::uint32_t* tri = &indices_[triangles_[k] * 3];
+						vec3f d = p - closest_on_triangle(p, verts_[tri[0]], verts_[tri[1]], verts_[tri[2]]);
+						best = std::min(best, d * d);
+					}
+				}
+		//whatever lies beyond shell r is at least r cells away from the cell of p
+		if (best <= r * cell_ * r * cell_) break;
+	}
+	return std::sqrt(best);
+}
+
+//Farthest that a point of one mesh gets from the surface of the other, both ways, sampled at the
+//vertices, edge midpoints and centroids of the triangles: a Hausdorff distance a little on the low side,
+//since it misses what happens between the samples.
+static float hausdorff_distance(const huge_vector<vec3f>& verts, const std::vector<std::uint32_t>& a, const std::vector<std::uint32_t>& b, const vec3f& bmin, const vec3f& bmax)
+{
+	float distance = 0;
+	for (int way = 0; way < 2; way++)
+	{
+		const std::vector<std::uint32_t>& from = way ? b : a;
+		TriangleGrid grid(verts, way ? a : b, bmin, bmax);
+		std::vector<bool> seen(verts.size());
+		for (std::uint32_t v : from)
+		{
+			if (seen[v]) continue;
+			seen[v] = true;
+			distance = std::max(distance, grid.distance(verts[v]));
+		}
+		for (size_t t = 0; t + 2 < from.size(); t += 3)
+		{
+			const vec3f& p = verts[from[t]];
+			const vec3f& q = verts[from[t + 1]];
+			const vec3f& r = verts[from[t + 2]];
+			const vec3f samples[] = { (p + q) / 2.f, (q + r) / 2.f, (r + p) / 2.f, (p + q + r) / 3.f };
+			for (const vec3f& s : samples) distance = std::max(distance, grid.distance(s));
+		}
+	}
+	return distance;
+}
+
+//LOD n+1 has half the triangles of LOD n, as long as the simplifier manages to get close to that;
+//the error of a LOD is its Hausdorff distance to the full mesh
+void Model::generate_lods()
+{
+	auto start = std::chrono::steady_clock::now();
+	lods_.clear();
+	lod_errors_.clear();
+	Simplifier simplifier(verts_, norms_, indices_);
+	size_t ntris = indices_.size() / 3;
+	while (ntris > 64 && lods_.size() < 12)
+	{
+		simplifier.simplify(ntris / 2);
+		size_t simplified = simplifier.indices().size() / 3;
+		if (simplified > ntris * 3 / 4) break;
+		lods_.push_back(simplifier.indices());
+		lod_errors_.push_back(hausdorff_distance(verts_, indices_, lods_.back(), bbox_min_, bbox_max_));
+		if (optimized_)
+		{
+			lods_.back() = tipsify(lods_.back(), verts_.size());
+			sort_clusters(lods_.back(), verts_, 1.05f);
+		}
+		ntris = simplified;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << "# LOD triangles " << indices_.size() / 3;
+	for (size_t i = 0; i < lods_.size(); i++) std::cerr << " " << lods_[i].size() / 3 << " (" << lod_errors_[i] << ")";
+	std::cerr << " in " << seconds * 1e3 << " ms" << std::endl;
+}
+
+static const std::uint32_t meshlet_max_vertices = 64;
+static const std::uint32_t meshlet_max_faces = 124;
+
+//Triangles are drawn from both sides, so each one faces the side of its vertex normals.
+//Zero for degenerate triangles.
+static vec3f face_normal(const std::uint32_t* tri, const huge_vector<vec3f>& verts, const huge_vector<vec3f>& norms)
+{
+	vec3f n = cross(verts[tri[1]] - verts[tri[0]], verts[tri[2]] - verts[tri[0]]);
+	float l = n.norm();
+	if (l <= 0) return vec3f(0, 0, 0);
+	n = n / l;
+	return n * (norms[tri[0]] + norms[tri[1]] + norms[tri[2]]) < 0 ? n * -1.f : n;
+}
+
+//Regroups the triangles so that every meshlet is a run of the index buffer, and returns the run
+//lengths. A meshlet starts at the first triangle left in the current order, which the reordering
+//passes made local, and grows over shared vertices, taking the neighbour that brings the fewest new
+//vertices and bends its normal cone the least. Its triangles then get their own vertex cache order.
+static std::vector<std::uint32_t> group_meshlets(std::vector<std::uint32_t>& indices, const huge_vector<vec3f>& verts, const huge_vector<vec3f>& norms)
+{
+	const std::uint32_t nfaces = std::uint32_t(indices.size() / 3);
+	std::vector<vec3f> normals(nfaces);
+	for (std::uint32_t f = 0; f < nfaces; f++) normals[f] = face_normal(&indices[f * 3], verts, norms);
+	std::vector<std::uint32_t> offsets(verts.size() + 1, 0);
+	for (std::uint32_t v : indices) offsets[v + 1]++;
+	for (size_t v = 0; v < verts.size(); v++) offsets[v + 1] += offsets[v];
+	std::vector<std::uint32_t> adjacency(indices.size());
+	std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++) adjacency[fill[indices[i]]++] = std::uint32_t(i / 3);
+
+	std::vector<std::uint32_t> sizes;
+	std::vector<std::uint32_t> result;
+	result.reserve(indices.size());
+	std::vector<bool> used(nfaces, false);
+	std::vector<std::uint32_t> stamp(verts.size(), 0);
+	std::vector<std::uint32_t> candidates;
+	std::vector<std::uint32_t> local, globals, local_ids(verts.size()), local_stamp(verts.size(), 0);
+	std::uint32_t seed = 0;
+	while (true)
+	{
+		while (seed < nfaces && used[seed]) seed++;
+		if (seed == nfaces) break;
+		const std::uint32_t id = std::uint32_t(sizes.size()) + 1;
+		std::uint32_t nverts = 0, count = 0;
+		vec3f axis(0, 0, 0);
+		candidates.clear();
+		for (std::uint32_t f = seed; f != ~0u && count < meshlet_max_faces;)
+		{
+			used[f] = true;
+			count++;
+			axis = axis + normals[f];
 			for (int i = 0; i < 3; i++)
 			{
-				iss >> n[i];
+				std::uint32_t v = indices[f * 3 + i];
+				result.push_back(v);
+				if (stamp[v] == id) continue;
+				stamp[v] = id;
+				nverts++;
+				candidates.insert(candidates.end(), adjacency.begin() + offsets[v], adjacency.begin() + offsets[v + 1]);
+			}
+
+			vec3f dir = axis * axis > 0 ? axis / axis.norm() : axis;
+			float best = std::numeric_limits<float>::max();
+			f = ~0u;
+			size_t kept = 0;
+			for (std::uint32_t c : candidates)
+			{
+				if (used[c]) continue;
+				candidates[kept++] = c;
+				std::uint32_t fresh = 0;
+				for (int i = 0; i < 3; i++) fresh += stamp[indices[c * 3 + i]] != id;
+				if (nverts + fresh > meshlet_max_vertices) continue;
+				float score = fresh + (1 - normals[c] * dir);
+				if (score < best)
+				{
+					best = score;
+					f = c;
+				}
 			}
-			norms_.push_back(n);
+			candidates.resize(kept);
 		}
-		else if (!line.compare(0, 3, "vt "))
+		sizes.push_back(count);
+
+		//tipsify over the meshlet's own vertex numbering, so it costs nothing per mesh vertex
+		std::uint32_t* tris = &result[result.size() - count * 3];
+		local.assign(count * 3, 0);
+		std::uint32_t nlocal = 0;
+		for (std::uint32_t i = 0; i < count * 3; i++)
 		{
-			iss >> trash >> trash;
-			vec2f t;
-			for (int i = 0; i < 2; i++)
+			if (local_stamp[tris[i]] != id)
 			{
-				iss >> t[i];
+				local_stamp[tris[i]] = id;
+				local_ids[tris[i]] = nlocal++;
 			}
-			uv_.push_back(t);
+			local[i] = local_ids[tris[i]];
 		}
-		else if (!line.compare(0, 2, "f "))
+		globals.resize(nlocal);
+		for (std::uint32_t i = 0; i < count * 3; i++) globals[local[i]] = tris[i];
+		local = tipsify(local, nlocal);
+		for (std::uint32_t i = 0; i < count * 3; i++) tris[i] = globals[local[i]];
+	}
+	indices.swap(result);
+	return sizes;
+}
+
+//bounding sphere and normal cone of the triangles [first, first + count)
+static Meshlet bound_meshlet(const std::vector<std::uint32_t>& indices, const std::uint32_t first, const std::uint32_t count, const huge_vector<vec3f>& verts, const huge_vector<vec3f>& norms)
+{
+	const std::uint32_t last = first + count;
+	Meshlet m;
+	m.first_face = first;
+	m.nfaces = count;
+	vec3f lo(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+	vec3f hi(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+	for (std::uint32_t i = first * 3; i < last * 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
 		{
-			iss >> trash;
-			std::vector<vec3i> f;
-			vec3i tmp;
-			while (iss >> tmp[0] >> trash >> tmp[1] >> trash >> tmp[2])
+			lo[j] = std::min(lo[j], verts[indices[i]][j]);
+			hi[j] = std::max(hi[j], verts[indices[i]][j]);
+		}
+	}
+	m.center = (lo + hi) * .5f;
+	m.radius = 0;
+	for (std::uint32_t i = first * 3; i < last * 3; i++) m.radius = std::max(m.radius, (verts[indices[i]] - m.center).norm());
+
+	m.cone_apex = m.center;
+	m.cone_axis = vec3f(0, 0, 1);
+	m.cone_cutoff = 2;
+	vec3f axis(0, 0, 0);
+	for (std::uint32_t f = first; f < last; f++) axis = axis + face_normal(&indices[f * 3], verts, norms);
+	float l = axis.norm();
+	if (l <= 0) return m;
+	axis = axis / l;
+	float mindp = 1;
+	for (std::uint32_t f = first; f < last; f++)
+	{
+		vec3f n = face_normal(&indices[f * 3], verts, norms);
+		if (n * n > 0) mindp = std::min(mindp, n * axis);
+	}
+	if (mindp <= .1f) return m;
+
+	//the apex sits behind every triangle's plane, so the test holds for eyes anywhere
+	float maxt = 0;
+	for (std::uint32_t f = first; f < last; f++)
+	{
+		vec3f n = face_normal(&indices[f * 3], verts, norms);
+		if (n * n > 0) maxt = std::max(maxt, (m.center - verts[indices[f * 3]]) * n / (axis * n));
+	}
+	m.cone_apex = m.center - axis * maxt;
+	m.cone_axis = axis;
+	m.cone_cutoff = std::sqrt(1 - mindp * mindp);
+	return m;
+}
+
+//with sort, the meshlets take the outward first order of sort_clusters()
+static std::vector<Meshlet> make_meshlets(std::vector<std::uint32_t>& indices, const huge_vector<vec3f>& verts, const huge_vector<vec3f>& norms, const bool sort)
+{
+	std::vector<std::uint32_t> sizes = group_meshlets(indices, verts, norms);
+	std::vector<Meshlet> meshlets;
+	meshlets.reserve(sizes.size());
+	std::uint32_t first = 0;
+	vec3f center(0, 0, 0);
+	for (std::uint32_t count : sizes)
+	{
+		meshlets.push_back(bound_meshlet(indices, first, count, verts, norms));
+		center = center + meshlets.back().center * float(count);
+		first += count;
+	}
+	if (!sort || meshlets.empty()) return meshlets;
+
+	center = center / float(indices.size() / 3);
+	std::vector<float> keys(meshlets.size());
+	for (size_t i = 0; i < meshlets.size(); i++)
+	{
+		const Meshlet& m = meshlets[i];
+		keys[i] = m.cone_cutoff <= 1 ? (m.center - center) * m.cone_axis : 0;
+	}
+	std::vector<std::uint32_t> order(meshlets.size());
+	for (size_t i = 0; i < order.size(); i++) order[i] = std::uint32_t(i);
+	std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) { return keys[a] > keys[b]; });
+	std::vector<std::uint32_t> result;
+	result.reserve(indices.size());
+	std::vector<Meshlet> sorted;
+	sorted.reserve(meshlets.size());
+	for (std::uint32_t i : order)
+	{
+		Meshlet m = meshlets[i];
+		result.insert(result.end(), indices.begin() + m.first_face * 3, indices.begin() + (m.first_face + m.nfaces) * 3);
+		m.first_face = std::uint32_t(result.size() / 3) - m.nfaces;
+		sorted.push_back(m);
+	}
+	indices.swap(result);
+	return sorted;
+}
+
+void Model::build_meshlets()
+{
+	meshlets_.clear();
+	float before = acmr(indices_, verts_.size());
+	meshlets_.push_back(make_meshlets(indices_, verts_, norms_, optimized_));
+	for (std::vector<std::uint32_t>& lod : lods_) meshlets_.push_back(make_meshlets(lod, verts_, norms_, optimized_));
+	std::cerr << "# meshlets " << meshlets_[0].size() << ", ACMR " << before << " -> " << acmr(indices_, verts_.size()) << std::endl;
+}
+
+//cheap 64 bit content hash, it only tells whether a .obj with a new mtime really changed
+static std::uint64_t hash_bytes(const std::uint8_t* p, const size_t n)
+{
+	std::uint64_t h = 0x9E3779B97F4A7C15ull ^ n;
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		std::uint64_t w;
+		memcpy(&w, p + i, 8);
+		h = (h ^ w) * 0x100000001B3ull;
+		h ^= h >> 29;
+	}
+	for (; i < n; i++) h = (h ^ p[i]) * 0x100000001B3ull;
+	return h;
+}
+
+//Binary mesh cache written next to the .obj: this header, the vertex positions, uvs and normals
+//(nverts of each), a MeshCacheLevel for every LOD, then the index buffer and meshlets of each LOD.
+struct MeshCacheHeader
+{
+	char magic[4];
+	std::uint32_t version;
+	std::uint64_t source_size;
+	std::int64_t source_mtime;
+	std::uint64_t source_hash;
+	std::uint32_t nverts;
+	std::uint32_t nlevels; //LOD 0 included
+	std::uint32_t optimized; //triangles are in the optimize_mesh() order
+	float bbox[6];
+};
+
+struct MeshCacheLevel
+{
+	std::uint32_t nindices;
+	float error;
+	std::uint32_t nmeshlets;
+};
+
+static const char mesh_cache_magic[4] = { 'M', 'E', 'S', 'H' };
+static const std::uint32_t mesh_cache_version = 6;
+
+static std::int64_t source_mtime(const std::string& filename)
+{
+	std::error_code ec;
+	std::filesystem::file_time_type t = std::filesystem::last_write_time(filename, ec);
+	return ec ? 0 : std::int64_t(t.time_since_epoch().count());
+}
+
+bool Model::load_cache(const std::string& objfile, const std::string& cachefile, std::uint64_t& source_hash)
+{
+	std::error_code ec;
+	if (!std::filesystem::exists(cachefile, ec)) return false;
+	MappedFile cache;
+	if (!cache.open(cachefile) || cache.size() < sizeof(MeshCacheHeader)) return false;
+	MeshCacheHeader header;
+	memcpy(&header, cache.data(), sizeof(header));
+	if (memcmp(header.magic, mesh_cache_magic, 4) || header.version != mesh_cache_version || !header.nlevels) return false;
+
+	std::uintmax_t size = std::filesystem::file_size(objfile, ec);
+	if (ec || size != header.source_size) return false;
+	if (header.source_mtime != source_mtime(objfile))
+	{
+		//touched or copied, but maybe not modified
+		MappedFile source;
+		if (!source.open(objfile) || hash_bytes(source.data(), source.size()) != header.source_hash) return false;
+	}
+
+	size_t pos = sizeof(header);
+	auto section = [&](void* dst, const size_t bytes)
+	{
+		if (bytes > cache.size() - pos) return false;
+		memcpy(dst, cache.data() + pos, bytes);
+		pos += bytes;
+		return true;
+	};
+	verts_.resize(header.nverts);
+	uv_.resize(header.nverts);
+	norms_.resize(header.nverts);
+	std::vector<MeshCacheLevel> levels(header.nlevels);
+	if (!section(verts_.data(), verts_.size() * sizeof(vec3f)) || !section(uv_.data(), uv_.size() * sizeof(vec2f)) ||
+		!section(norms_.data(), norms_.size() * sizeof(vec3f)) || !section(levels.data(), levels.size() * sizeof(MeshCacheLevel))) return false;
+
+	lods_.resize(header.nlevels - 1);
+	lod_errors_.resize(header.nlevels - 1);
+	meshlets_.resize(header.nlevels);
+	for (std::uint32_t l = 0; l < header.nlevels; l++)
+	{
+		std::vector<std::uint32_t>& indices = l ? lods_[l - 1] : indices_;
+		if (levels[l].nindices % 3) return false;
+		indices.resize(levels[l].nindices);
+		meshlets_[l].resize(levels[l].nmeshlets);
+		if (!section(indices.data(), indices.size() * sizeof(std::uint32_t)) || !section(meshlets_[l].data(), meshlets_[l].size() * sizeof(Meshlet))) return false;
+		for (std::uint32_t i : indices)
+			if (i >= header.nverts) return false;
+		for (const Meshlet& m : meshlets_[l])
+			if (m.first_face > indices.size() / 3 || m.nfaces > indices.size() / 3 - m.first_face) return false;
+		if (l) lod_errors_[l - 1] = levels[l].error;
+	}
+	if (pos != cache.size()) return false;
+
+	bbox_min_ = vec3f(header.bbox[0], header.bbox[1], header.bbox[2]);
+	bbox_max_ = vec3f(header.bbox[3], header.bbox[4], header.bbox[5]);
+	optimized_ = header.optimized != 0;
+	source_hash = header.source_hash;
+	return true;
+}
+
+void Model::save_cache(const std::string& objfile, const std::string& cachefile, const std::uint64_t source_hash)
+{
+	std::error_code ec;
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, mesh_cache_magic, 4);
+	header.version = mesh_cache_version;
+	header.source_size = std::filesystem::file_size(objfile, ec);
+	header.source_mtime = source_mtime(objfile);
+	header.source_hash = source_hash;
+	header.nverts = std::uint32_t(verts_.size());
+	header.nlevels = std::uint32_t(meshlets_.size());
+	header.optimized = optimized_;
+	for (int i = 0; i < 3; i++)
+	{
+		header.bbox[i] = bbox_min_[i];
+		header.bbox[3 + i] = bbox_max_[i];
+	}
+	std::vector<MeshCacheLevel> levels(meshlets_.size());
+	for (size_t l = 0; l < levels.size(); l++)
+	{
+		levels[l].nindices = std::uint32_t((l ? lods_[l - 1] : indices_).size());
+		levels[l].error = l ? lod_errors_[l - 1] : 0.f;
+		levels[l].nmeshlets = std::uint32_t(meshlets_[l].size());
+	}
+
+	//written aside and renamed, so a reader never maps a half written cache
+	std::string tmpfile = cachefile + ".tmp";
+	std::ofstream out(tmpfile, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(verts_.data()), verts_.size() * sizeof(vec3f));
+	out.write(reinterpret_cast<const char*>(uv_.data()), uv_.size() * sizeof(vec2f));
+	out.write(reinterpret_cast<const char*>(norms_.data()), norms_.size() * sizeof(vec3f));
+	out.write(reinterpret_cast<const char*>(levels.data()), levels.size() * sizeof(MeshCacheLevel));
+	for (size_t l = 0; l < levels.size(); l++)
+	{
+		const std::vector<std::uint32_t>& indices = l ? lods_[l - 1] : indices_;
+		out.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(std::uint32_t));
+		out.write(reinterpret_cast<const char*>(meshlets_[l].data()), meshlets_[l].size() * sizeof(Meshlet));
+	}
+	out.close();
+	if (!out.good())
+	{
+		std::cerr << "can't write mesh cache " << cachefile << std::endl;
+		std::filesystem::remove(tmpfile, ec);
+		return;
+	}
+	std::filesystem::rename(tmpfile, cachefile, ec);
+	if (ec)
+	{
+		std::cerr << "can't write mesh cache " << cachefile << std::endl;
+		std::filesystem::remove(tmpfile, ec);
+	}
+}
+
+Model::Model() : verts_(), norms_(), uv_(), packed_(), indices_(), lods_(), lod_errors_(), meshlets_(1), lod_(0), bbox_min_(), bbox_max_(), optimized_(false), diffusemap_(), specularmap_(), normalmap_(), diffusebc_(), normalbc_(), textures_()
+{
+}
+
+Model::Model(const char* filename, const int flags) : verts_(), norms_(), uv_(), packed_(), indices_(), lods_(), lod_errors_(), meshlets_(), lod_(0), bbox_min_(), bbox_max_(), optimized_(false), diffusemap_(), specularmap_(), normalmap_(), diffusebc_(), normalbc_(), textures_()
+{
+	assert(filename != 0);
+	std::string objfile(filename);
+	ThreadPool& pool = ThreadPool::shared();
+	const bool compress = flags & COMPRESS_TEXTURES;
+	textures_[0] = pool.submit([this, objfile, compress]()
+	{
+		load_texture(objfile, "_diffuse.tga", diffusemap_);
+		if (compress) compress_texture(diffusemap_, diffusebc_, BCTexture::BC1);
+	}).share();
+	textures_[1] = pool.submit([this, objfile, compress]()
+	{
+		load_texture(objfile, "_nm.tga", normalmap_);
+		if (compress) compress_texture(normalmap_, normalbc_, BCTexture::BC5);
+	}).share();
+	textures_[2] = pool.submit([this, objfile]() { load_texture(objfile, "_spec.tga", specularmap_); }).share();
+
+	size_t dot = objfile.find_last_of(".");
+	std::string cachefile = (dot != std::string::npos ? objfile.substr(0, dot) : objfile) + ".mesh";
+
+	auto start = std::chrono::steady_clock::now();
+	std::uint64_t source_hash = 0;
+	if (!(flags & NO_MESH_CACHE) && load_cache(objfile, cachefile, source_hash))
+	{
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cerr << "# loaded mesh cache " << cachefile << " in " << seconds * 1e3 << " ms" << std::endl;
+		bool stale = false;
+		if ((flags & OPTIMIZE_MESH) && !optimized_)
+		{
+			optimize_mesh();
+			stale = true;
+		}
+		if ((flags & GENERATE_LODS) && lods_.empty())
+		{
+			generate_lods();
+			stale = true;
+		}
+		if (stale)
+		{
+			build_meshlets();
+			save_cache(objfile, cachefile, source_hash);
+		}
+	}
+	else
+	{
+		verts_.clear();
+		uv_.clear();
+		norms_.clear();
+		indices_.clear();
+		lods_.clear();
+		lod_errors_.clear();
+		meshlets_.clear();
+		optimized_ = false;
+		MappedFile file;
+		if (file.open(filename))
+		{
+			const char* text = reinterpret_cast<const char*>(file.data());
+			parse_obj(text, text + file.size());
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			std::cerr << "# parsed " << file.size() / 1e6 << " MB in " << seconds * 1e3 << " ms (" << file.size() / 1e6 / seconds << " MB/s)" << std::endl;
+
+			bbox_min_ = vec3f(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+			bbox_max_ = vec3f(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+			for (const vec3f& v : verts_)
 			{
-				//remember to correct the indices
-				for (int i = 0; i < 3; i++) tmp[i]--;
-				f.push_back(tmp);
+				for (int i = 0; i < 3; i++)
+				{
+					bbox_min_[i] = std::min(bbox_min_[i], v[i]);
+					bbox_max_[i] = std::max(bbox_max_[i], v[i]);
+				}
 			}
-			
-			faces_.push_back(f);
+			if (flags & OPTIMIZE_MESH) optimize_mesh();
+			if (flags & GENERATE_LODS) generate_lods();
+			build_meshlets();
+			if (!(flags & NO_MESH_CACHE)) save_cache(objfile, cachefile, hash_bytes(file.data(), file.size()));
 		}
 	}
 
-	std::cerr << "# V# " << verts_.size() << " F# " << faces_.size() << " vt# " << uv_.size() << " vn# " << norms_.size() << std::endl;
-	load_texture(filename, "_diffuse.tga", diffusemap_);
-	load_texture(filename, "_nm.tga", normalmap_);
-	load_texture(filename, "_spec.tga", specularmap_);
+	if (meshlets_.empty()) build_meshlets();
+	std::cerr << "# V# " << verts_.size() << " F# " << indices_.size() / 3 << " meshlets# " << meshlets_[0].size() << std::endl;
+	if (flags & COMPACT_VERTICES) pack_vertices();
+	if (!(flags & ASYNC_TEXTURES)) wait_textures();
+}
+
+Model::~Model()
+{
+	wait_textures();
 }
 
-Model::~Model() {}
+std::future<Model*> Model::load_async(const char* filename, const int flags)
+{
+	std::string objfile(filename);
+	return ThreadPool::shared().submit([objfile, flags]() { return new Model(objfile.c_str(), flags | ASYNC_TEXTURES); });
+}
+
+void Model::wait_textures()
+{
+	for (const std::shared_future<void>& job : textures_)
+	{
+		if (job.valid()) ThreadPool::shared().wait(job);
+	}
+}
 
 int Model::nverts()
 {
-	return (int)verts_.size();
+	return (int)(packed_.empty() ? verts_.size() : packed_.size());
 }
 
 int Model::nfaces()
 {
-	return (int)faces_.size();
+	return (int)(lod_indices().size() / 3);
 }
 
-std::vector<int> Model::face(int idx)
+FaceRef Model::face(int iface)
 {
-	std::vector<int> face;
-	for (int i = 0; i < (int)faces_[idx].size(); i++) face.push_back(faces_[idx][i][0]);
-	return face;
+	return FaceRef{ &lod_indices()[iface * 3] };
+}
+
+const std::vector<std::uint32_t>& Model::indices()
+{
+	return lod_indices();
+}
+
+const std::vector<std::uint32_t>& Model::lod_indices()
+{
+	return lod_ ? lods_[lod_ - 1] : indices_;
+}
+
+const std::vector<Meshlet>& Model::meshlets()
+{
+	return meshlets_[lod_];
+}
+
+int Model::nlods()
+{
+	return (int)lods_.size() + 1;
+}
+
+void Model::set_lod(int lod)
+{
+	lod_ = std::max(0, std::min(lod, (int)lods_.size()));
+}
+
+int Model::select_lod(float screen_size, float pixel_error)
+{
+	vec3f extent = bbox_max_ - bbox_min_;
+	float size = std::max(extent.x, std::max(extent.y, extent.z));
+	if (size <= 0) return 0;
+	float pixels_per_unit = screen_size / size;
+	int lod = 0;
+	while (lod < (int)lods_.size() && lod_errors_[lod] * pixels_per_unit <= pixel_error) lod++;
+	return lod;
+}
+
+vec3f Model::bbox_min()
+{
+	return bbox_min_;
+}
+
+vec3f Model::bbox_max()
+{
+	return bbox_max_;
 }
 
 vec3f Model::vert(int i)
 {
-	return verts_[i];
+	if (packed_.empty()) return verts_[i];
+	vec3f v;
+	packed_.position(i, &v.x);
+	return v;
 }
 
 vec3f Model::vert(int iface, int nthvert)
 {
-	return verts_[faces_[iface][nthvert][0]];
+	return vert((int)lod_indices()[iface * 3 + nthvert]);
+}
+
+void Model::pack_vertices()
+{
+	if (verts_.empty()) return;
+	packed_.encode(&verts_[0].x, &uv_[0].x, &norms_[0].x, verts_.size(), &bbox_min_.x, &bbox_max_.x);
+	std::cerr << "vertices packed " << verts_.size() * (2 * sizeof(vec3f) + sizeof(vec2f)) << " -> " << packed_.memory() << " bytes" << std::endl;
+	huge_vector<vec3f>().swap(verts_);
+	huge_vector<vec2f>().swap(uv_);
+	huge_vector<vec3f>().swap(norms_);
 }
 
 void Model::load_texture(std::string filename, const char* suffix, TGAImage& img)
@@ -107,21 +1564,42 @@ void Model::load_texture(std::string filename, const char* suffix, TGAImage& img
 	if (dot != std::string::npos)
 	{
 		texfile = texfile.substr(0, dot) + std::string(suffix);
-		std::cerr << "texture file" << texfile << " loading " << (img.read_tga_file(texfile.c_str()) ? "ok" : "failed") << std::endl;
+		std::cerr << "texture file" << texfile << " loading " << (img.map_tga_file(texfile.c_str()) ? "ok" : "failed") << std::endl;
 		img.flip_vertically();
 	}
 }
 
+void Model::compress_texture(TGAImage& img, BCTexture& bc, const BCTexture::Format fmt)
+{
+	if (img.get_width() <= 0 || !bc.encode(img, fmt)) return;
+	std::cerr << "texture compressed " << img.get_width() * img.get_height() * img.get_bytespp() << " -> " << bc.memory() << " bytes" << std::endl;
+	img = TGAImage();
+}
+
 TGAColor Model::diffuse(vec2f uvf)
 {
+	if (!diffusebc_.empty())
+	{
+		vec2i uv(uvf[0] * diffusebc_.get_width(), uvf[1] * diffusebc_.get_height());
+		return diffusebc_.get(uv[0], uv[1]);
+	}
 	vec2i uv(uvf[0] * diffusemap_.get_width(), uvf[1] * diffusemap_.get_height());
 	return diffusemap_.get(uv[0], uv[1]);
 }
 
 vec3f Model::normal(vec2f uvf)
 {
-	vec2i uv(uvf[0] * normalmap_.get_width(), uvf[1] * normalmap_.get_height());
-	TGAColor c = normalmap_.get(uv[0], uv[1]);
+	TGAColor c;
+	if (!normalbc_.empty())
+	{
+		vec2i uv(uvf[0] * normalbc_.get_width(), uvf[1] * normalbc_.get_height());
+		c = normalbc_.get(uv[0], uv[1]);
+	}
+	else
+	{
+		vec2i uv(uvf[0] * normalmap_.get_width(), uvf[1] * normalmap_.get_height());
+		c = normalmap_.get(uv[0], uv[1]);
+	}
 	vec3f res;
 	for (int i = 0; i < 3; i++)
 	{
@@ -132,7 +1610,11 @@ vec3f Model::normal(vec2f uvf)
 
 vec2f Model::uv(int iface, int nthvert)
 {
-	return uv_[faces_[iface][nthvert][1]];
+	std::uint32_t i = lod_indices()[iface * 3 + nthvert];
+	if (packed_.empty()) return uv_[i];
+	vec2f uv;
+	packed_.uv(i, &uv.x);
+	return uv;
 }
 
 float Model::specular(vec2f uvf)
@@ -144,14 +1626,204 @@ float Model::specular(vec2f uvf)
 
 vec3f Model::normal(int iface, int nthvert)
 {
-	int idx = faces_[iface][nthvert][2];
-	return norms_[idx].normalize();
+	std::uint32_t i = lod_indices()[iface * 3 + nthvert];
+	if (packed_.empty()) return norms_[i];
+	vec3f n;
+	packed_.normal(i, &n.x);
+	return n;
+}
+
+
+
+
+
+
+
+
+
+ModelStream::ModelStream(const char* filename, const size_t chunk_faces) : obj_(), records_(), spill_(), nrecords_(), nread_(), offset_(0), chunk_faces_(std::max<size_t>(chunk_faces, 1)), corners_()
+{
+	assert(filename != 0);
+	if (!obj_.open(filename)) return;
+	std::filesystem::path prefix = std::filesystem::temp_directory_path() / std::filesystem::path(filename).stem();
+	std::string tag = "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+	auto start = std::chrono::steady_clock::now();
+	if (!spill(prefix.string() + tag))
+	{
+		std::cerr << "can't spill the records of " << filename << " to " << prefix.parent_path().string() << std::endl;
+		obj_.close();
+		return;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << "# spilled " << nrecords_[0] << " v, " << nrecords_[1] << " vt, " << nrecords_[2] << " vn in " << seconds * 1e3 << " ms" << std::endl;
+}
+
+ModelStream::~ModelStream()
+{
+	std::error_code ec;
+	for (int i = 0; i < 3; i++)
+	{
+		records_[i].close();
+		if (!spill_[i].empty()) std::filesystem::remove(spill_[i], ec);
+	}
 }
 
+//how much text the passes go through before giving its pages back
+static const size_t discard_bytes = 8 << 20;
+
+//first pass: the records go to three binary files through small buffers, then get mapped back
+bool ModelStream::spill(const std::string& prefix)
+{
+	const char* suffixes[3] = { ".v", ".vt", ".vn" };
+	const int dims[3] = { 3, 2, 3 };
+	std::ofstream out[3];
+	std::vector<float> buffers[3];
+	for (int i = 0; i < 3; i++)
+	{
+		spill_[i] = prefix + suffixes[i];
+		out[i].open(spill_[i], std::ios::binary | std::ios::trunc);
+		if (!out[i]) return false;
+		buffers[i].reserve(1 << 16);
+	}
+	auto flush = [&](int i)
+	{
+		out[i].write(reinterpret_cast<const char*>(buffers[i].data()), buffers[i].size() * sizeof(float));
+		buffers[i].clear();
+	};
+
+	const char* text = reinterpret_cast<const char*>(obj_.data());
+	const char* end = text + obj_.size();
+	size_t discarded = 0;
+	for (const char* begin = text; begin < end;)
+	{
+		const char* eol = static_cast<const char*>(memchr(begin, '\n', end - begin));
+		if (!eol) eol = end;
+		const char* p = begin;
+		begin = eol + 1;
+		if (size_t(p - text) - discarded >= discard_bytes)
+		{
+			obj_.discard(discarded, p - text - discarded);
+			discarded = p - text;
+		}
 
+		int kind = starts_with(p, eol, "v ") ? 0 : starts_with(p, eol, "vt ") ? 1 : starts_with(p, eol, "vn ") ? 2 : -1;
+		if (kind < 0) continue;
+		p += kind ? 3 : 2;
+		vec3f r;
+		for (int i = 0; i < dims[kind] && parse_number(p, eol, r[i]); i++);
+		if (2 == kind) r.normalize();
+		for (int i = 0; i < dims[kind]; i++) buffers[kind].push_back(r[i]);
+		nrecords_[kind]++;
+		if (buffers[kind].size() + 3 > buffers[kind].capacity()) flush(kind);
+	}
+	obj_.discard(discarded, obj_.size() - discarded);
+	for (int i = 0; i < 3; i++)
+	{
+		flush(i);
+		out[i].close();
+		if (!out[i] || (nrecords_[i] && !records_[i].open(spill_[i]))) return false;
+	}
+	return true;
+}
 
+bool ModelStream::next(Model& chunk)
+{
+	chunk.verts_.clear();
+	chunk.uv_.clear();
+	chunk.norms_.clear();
+	chunk.packed_ = PackedVertices();
+	chunk.indices_.clear();
+	chunk.lods_.clear();
+	chunk.lod_errors_.clear();
+	chunk.meshlets_.clear();
+	chunk.lod_ = 0;
+	chunk.optimized_ = false;
 
+	const char* text = reinterpret_cast<const char*>(obj_.data());
+	const char* end = text + obj_.size();
+	const char* begin = text + offset_;
+	const float* records[3];
+	for (int i = 0; i < 3; i++) records[i] = reinterpret_cast<const float*>(records_[i].data());
 
+	TripletTable table;
+	table.reset(chunk_faces_ * 3);
+	auto vertex = [&](const vec3i& key) -> std::uint32_t
+	{
+		bool added;
+		std::uint32_t index = table.insert(key, added);
+		if (added)
+		{
+			//a record the file does not have reads as zero
+			vec3f v, n;
+			vec2f t;
+			if (size_t(key[0]) < nrecords_[0]) v = vec3f(records[0][size_t(key[0]) * 3], records[0][size_t(key[0]) * 3 + 1], records[0][size_t(key[0]) * 3 + 2]);
+			if (size_t(key[1]) < nrecords_[1]) t = vec2f(records[1][size_t(key[1]) * 2], records[1][size_t(key[1]) * 2 + 1]);
+			if (size_t(key[2]) < nrecords_[2]) n = vec3f(records[2][size_t(key[2]) * 3], records[2][size_t(key[2]) * 3 + 1], records[2][size_t(key[2]) * 3 + 2]);
+			chunk.verts_.push_back(v);
+			chunk.uv_.push_back(t);
+			chunk.norms_.push_back(n);
+		}
+		return index;
+	};
 
+	while (begin < end && chunk.indices_.size() < chunk_faces_ * 3)
+	{
+		const char* eol = static_cast<const char*>(memchr(begin, '\n', end - begin));
+		if (!eol) eol = end;
+		const char* p = begin;
+		begin = eol + 1;
+		if (size_t(p - text) - offset_ >= discard_bytes)
+		{
+			obj_.discard(offset_, p - text - offset_);
+			offset_ = p - text;
+		}
 
+		if (starts_with(p, eol, "v ")) nread_[0]++;
+		else if (starts_with(p, eol, "vt ")) nread_[1]++;
+		else if (starts_with(p, eol, "vn ")) nread_[2]++;
+		else if (starts_with(p, eol, "f "))
+		{
+			p += 2;
+			vec3i tmp;
+			corners_.clear();
+			while (parse_triplet(p, eol, tmp))
+			{
+				for (int i = 0; i < 3; i++) tmp[i] += tmp[i] >= 0 ? -1 : int(nread_[i]);
+				corners_.push_back(tmp);
+			}
+			if (corners_.size() < 3) continue;
+			std::uint32_t first = vertex(corners_[0]);
+			std::uint32_t prev = vertex(corners_[1]);
+			for (size_t i = 2; i < corners_.size(); i++)
+			{
+				std::uint32_t cur = vertex(corners_[i]);
+				chunk.indices_.push_back(first);
+				chunk.indices_.push_back(prev);
+				chunk.indices_.push_back(cur);
+				prev = cur;
+			}
+		}
+	}
+	//the text is behind us and the records were copied out, what stays resident is the chunk itself
+	size_t offset = std::min<size_t>(begin - text, obj_.size());
+	obj_.discard(offset_, offset - offset_);
+	offset_ = offset;
+	for (int i = 0; i < 3; i++) records_[i].discard(0, records_[i].size());
 
+	if (chunk.indices_.empty())
+	{
+		chunk.meshlets_.resize(1);
+		return false;
+	}
+	chunk.bbox_min_ = chunk.bbox_max_ = chunk.verts_[0];
+	for (const vec3f& v : chunk.verts_)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			chunk.bbox_min_[i] = std::min(chunk.bbox_min_[i], v[i]);
+			chunk.bbox_max_[i] = std::max(chunk.bbox_max_[i], v[i]);
+		}
+	}
+	chunk.meshlets_.push_back(make_meshlets(chunk.indices_, chunk.verts_, chunk.norms_, false));
+	return true;
+}
@@ -1,7 +1,9 @@
 #include <cmath>
 #include <limits>
 #include <cstdlib>
+#include <algorithm>
 #include "our_gl.h"
+#include "model.h"
 
 Matrix ModelView;
 Matrix Projection;
@@ -10,39 +12,52 @@ Matrix Viewport;
 
 IShader ::~IShader() {}
 
-void viewport(int x, int y, int w, int h)
-{
-	Viewport = Matrix::identity();
-
-	Viewport[0][3] = x + w / 2.f;
-	Viewport[1][3] = y + h / 2.f;
-	Viewport[2][3] = 1.f;
-	Viewport[0][0] = w / 2.f;
-	Viewport[1][1] = h / 2.f;
-	Viewport[2][2] = 0;
-}
-
-void projection(float coeff)
-{
-	Projection = Matrix::identity();
-	Projection[3][2] = coeff;
-}
+static_assert(viewport_matrix(0, 0, 800, 800)[0][3] == 400 && (viewport_matrix(0, 0, 800, 800) * embed<4>(vec3f(1, -1, 0)))[1] == 0, "viewport");
 
-void lookat(vec3f eye, vec3f center, vec3f up)
+Matrix lookat_matrix(vec3f eye, vec3f center, vec3f up)
 {
 	vec3f z = (eye - center).normalize();
 	vec3f x = cross(up, z).normalize();
 	vec3f y = cross(z, x).normalize();
 
-	ModelView = Matrix::identity();
+	Matrix ret = Matrix::identity();
 	
 	for (int i = 0; i < 3; i++)
 	{
-		ModelView[0][i] = x[i];
-		ModelView[1][i] = y[i];
-		ModelView[2][i] = z[i];
-		ModelView[i][3] = -center[i];
+		ret[0][i] = x[i];
+		ret[1][i] = y[i];
+		ret[2][i] = z[i];
+		ret[i][3] = -center[i];
+	}
+	return ret;
+}
+
+//screen rectangle covering a box, false when part of the box is behind the eye
+static bool screen_rect(const Matrix& m, vec3f bbox_min, vec3f bbox_max, vec2f& lo, vec2f& hi)
+{
+	lo = vec2f(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+	hi = vec2f(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+	for (int i = 0; i < 8; i++)
+	{
+		vec3f corner(i & 1 ? bbox_max.x : bbox_min.x, i & 2 ? bbox_max.y : bbox_min.y, i & 4 ? bbox_max.z : bbox_min.z);
+		vec4f p = m * embed<4>(corner);
+		if (p[3] <= 0) return false;
+		for (int j = 0; j < 2; j++)
+		{
+			lo[j] = std::min(lo[j], p[j] / p[3]);
+			hi[j] = std::max(hi[j], p[j] / p[3]);
+		}
 	}
+	return true;
+}
+
+static float screen_size(const Matrix& modelview, const Matrix& projection, const Matrix& viewport, vec3f bbox_min, vec3f bbox_max)
+{
+	Matrix vp = viewport * projection;
+	Matrix m = vp * modelview;
+	vec2f lo, hi;
+	if (!screen_rect(m, bbox_min, bbox_max, lo, hi)) return std::numeric_limits<float>::max();
+	return std::max(hi.x - lo.x, hi.y - lo.y);
 }
 
 vec3f barycentric(vec2f A, vec2f B, vec2f C, vec2f P)
@@ -66,11 +81,11 @@ vec3f barycentric(vec2f A, vec2f B, vec2f C, vec2f P)
 }
 
 
-void triangle(mat<4, 3, float>& clipc, IShader& shader, TGAImage& image, float* zbuffer)
+static void triangle(const Matrix& viewport, mat<4, 3, float>& clipc, IShader& shader, TGAImage& image, float* zbuffer, RenderStats& stats)
 {
 	//screenspace
 	
-	mat<3, 4, float> pts = (Viewport * clipc).transpose();
+	mat<3, 4, float> pts = (viewport * clipc).transpose();
 	//std::cout << pts[0] << std::endl;
 	//std::cout << pts[1] << std::endl;
 //	std::cout << pts[2] << std::endl;
@@ -99,6 +114,7 @@ void triangle(mat<4, 3, float>& clipc, IShader& shader, TGAImage& image, float*
 	
 	vec2i P;
 	TGAColor color;
+	std::uint64_t fragments = 0;
 
 	for (P.x = bboxmin.x; P.x <= bboxmax.x; P.x++)
 	{
@@ -114,6 +130,7 @@ void triangle(mat<4, 3, float>& clipc, IShader& shader, TGAImage& image, float*
 			if (bc_screen.x < 0 || bc_screen.y < 0 || bc_screen.z < 0 || zbuffer[P.x + P.y * image.get_width()] > frag_depth) continue;
 			
 			bool discard = shader.fragment(vec3f(P.x, P.y, frag_depth), bc_clip, color);
+			fragments++;
 			if (!discard)
 			{
 				zbuffer[P.x + P.y * image.get_width()] = frag_depth;
@@ -121,9 +138,129 @@ void triangle(mat<4, 3, float>& clipc, IShader& shader, TGAImage& image, float*
 			}
 		}
 	}
+	stats.triangles++;
+	stats.fragments += fragments;
+}
+
+static int draw(const Matrix& modelview, const Matrix& projection, const Matrix& viewport, Model& model, IShader& shader, TGAImage& image, float* zbuffer, bool cull_backfaces, RenderStats& stats)
+{
+	Matrix vp = viewport * projection;
+	Matrix m = vp * modelview;
+	//the eye in view space is where the projection sends w to 0; no eye means parallel projection along -z
+	bool perspective = projection[3][2] != 0;
+	vec3f eye(0, 0, perspective ? -projection[3][3] / projection[3][2] : 0);
+
+	int drawn = 0;
+	mat<4, 3, float> clipc;
+	for (const Meshlet& meshlet : model.meshlets())
+	{
+		vec3f r(meshlet.radius, meshlet.radius, meshlet.radius);
+		vec2f lo, hi;
+		if (screen_rect(m, meshlet.center - r, meshlet.center + r, lo, hi) && (hi.x < 0 || hi.y < 0 || lo.x > image.get_width() - 1 || lo.y > image.get_height() - 1))
+		{
+			stats.meshlets_culled++;
+			continue;
+		}
+		if (cull_backfaces && meshlet.cone_cutoff <= 1)
+		{
+			vec3f apex = proj<3>(modelview * embed<4>(meshlet.cone_apex));
+			vec3f axis = proj<3>(modelview * embed<4>(meshlet.cone_axis, 0.f));
+			vec3f dir = perspective ? (apex - eye).normalize() : vec3f(0, 0, -1);
+			if (dir * axis >= meshlet.cone_cutoff)
+			{
+				stats.meshlets_culled++;
+				continue;
+			}
+		}
+
+		for (std::uint32_t i = meshlet.first_face; i < meshlet.first_face + meshlet.nfaces; i++)
+		{
+			for (int j = 0; j < 3; j++) clipc.set_col(j, shader.vertex(i, j));
+			triangle(viewport, clipc, shader, image, zbuffer, stats);
+		}
+		drawn += meshlet.nfaces;
+	}
+	return drawn;
+}
+
+RenderContext::RenderContext(int width, int height, int bpp) : ModelView(Matrix::identity()), Projection(Matrix::identity()), Viewport(Matrix::identity()),
+	image(width, height, bpp), zbuffer(), stats(), zstorage(width * height, -std::numeric_limits<float>::max())
+{
+	zbuffer = zstorage.data();
+}
+
+RenderContext::RenderContext(int width, int height, FrameArena& arena, int bpp) : ModelView(Matrix::identity()), Projection(Matrix::identity()), Viewport(Matrix::identity()),
+	image(width, height, bpp, arena.allocate<std::uint8_t>(width * height * bpp)), zbuffer(arena.allocate<float>(width * height)), stats(), zstorage()
+{
+	std::fill(zbuffer, zbuffer + width * height, -std::numeric_limits<float>::max());
+}
+
+void RenderContext::viewport(int x, int y, int w, int h)
+{
+	Viewport = viewport_matrix(x, y, w, h);
+}
+
+void RenderContext::projection(float coeff)
+{
+	Projection = projection_matrix(coeff);
+}
+
+void RenderContext::lookat(vec3f eye, vec3f center, vec3f up)
+{
+	ModelView = lookat_matrix(eye, center, up);
+}
+
+float RenderContext::screen_size(vec3f bbox_min, vec3f bbox_max) const
+{
+	return ::screen_size(ModelView, Projection, Viewport, bbox_min, bbox_max);
+}
+
+void RenderContext::clear()
+{
+	image.clear();
+	std::fill(zbuffer, zbuffer + image.get_width() * image.get_height(), -std::numeric_limits<float>::max());
+	stats = RenderStats();
+}
+
+void triangle(RenderContext& gl, mat<4, 3, float>& clipc, IShader& shader)
+{
+	triangle(gl.Viewport, clipc, shader, gl.image, gl.zbuffer, gl.stats);
 }
 
+int draw(RenderContext& gl, Model& model, IShader& shader, bool cull_backfaces)
+{
+	return draw(gl.ModelView, gl.Projection, gl.Viewport, model, shader, gl.image, gl.zbuffer, cull_backfaces, gl.stats);
+}
+
+void viewport(int x, int y, int w, int h)
+{
+	Viewport = viewport_matrix(x, y, w, h);
+}
+
+void projection(float coeff)
+{
+	Projection = projection_matrix(coeff);
+}
 
+void lookat(vec3f eye, vec3f center, vec3f up)
+{
+	ModelView = lookat_matrix(eye, center, up);
+}
 
+float screen_size(vec3f bbox_min, vec3f bbox_max)
+{
+	return screen_size(ModelView, Projection, Viewport, bbox_min, bbox_max);
+}
 
+//the global interface keeps no counters, each call counts into its own and drops them
+void triangle(mat<4, 3, float>& clipc, IShader& shader, TGAImage& image, float* zbuffer)
+{
+	RenderStats discarded;
+	triangle(Viewport, clipc, shader, image, zbuffer, discarded);
+}
 
+int draw(Model& model, IShader& shader, TGAImage& image, float* zbuffer, bool cull_backfaces)
+{
+	RenderStats discarded;
+	return draw(ModelView, Projection, Viewport, model, shader, image, zbuffer, cull_backfaces, discarded);
+}